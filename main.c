@@ -6,8 +6,38 @@
  * page faults using the Demand Paging Algorithm.
  * ----------------------------------------------------------------------------------- */
 
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+/// Phase timers are compiled in by default and switched on with --timings.
+/// Build with -DVMM_PHASE_TIMERS=0 to remove them entirely.
+#ifndef VMM_PHASE_TIMERS
+#define VMM_PHASE_TIMERS 1
+#endif
 
 #define UNMAPPED                     -1
 #define FRAME_SIZE                   256
@@ -17,15 +47,84 @@
 #define PAGE_TABLE_SIZE              256
 #define PAGE_SIZE                    256
 #define PHYSICAL_MEMORY_SIZE         PAGE_TABLE_SIZE * PAGE_SIZE
+#define TRACE_BINARY_MAGIC           "VMMTRACE"
+#define TRACE_BINARY_MAGIC_SIZE      8
+#define TRACE_DEFAULT_SEED           20180101
+#define TRACE_WRITE_BUFFER_SIZE      (1 << 20)
+#define TRACE_MAX_MIX_MODELS         8
+#define DEFAULT_ADDRESS_BITS         16
+#define MAX_ADDRESS_BITS             40
+#define DEFAULT_MAX_FRAMES           (1 << 20)
+#define STORE_DEFAULT_DENSITY        0.01
+#define TRANSLATION_FORMAT           "Virtual address: %" PRIu64 " Physical address: %" PRIu64 " Value: %d\n"
+#define BENCH_DEFAULT_OPS            1000000
+#define BENCH_DEFAULT_REPETITIONS    31
+#define BENCH_DEFAULT_WARMUP         3
+#define TRACE_BATCH_SIZE             (1 << 16)
+#define THROUGHPUT_DEFAULT_SIZES     "1K,1M,100M,1B"
+#define HISTOGRAM_SUB_BUCKET_BITS    6
+#define HISTOGRAM_MAX_VALUE_BITS     44
+#define EVENT_RING_DEFAULT_CAPACITY  (1 << 20)
+#define LIVE_STATISTICS_MAGIC        0x564D4D4C49564532ULL
+#define WATCH_DEFAULT_INTERVAL_MS    1000
+#define WATCH_DEFAULT_TIMEOUT_MS     30000
+#define HEATMAP_DEFAULT_WINDOW       100000
+#define HEATMAP_BINARY_MAGIC         "VMMHEAT1"
+#define HOT_PAGES_COUNTERS_PER_PAGE  16
+#define HOT_PAGES_MIN_COUNTERS       1024
+#define HOT_PAGES_EMPTY              UINT32_MAX
+#define AGING_TICK_DIVISOR           4
+#define LIRS_HIR_PERCENT             1
+#define LIRS_NONRESIDENT_RATIO       2
+#define PREFETCH_MAX_DEGREE          16
+#define PREFETCH_DEFAULT_DEGREE      2
+#define STRIDE_DEFAULT_STREAMS       16
+#define STRIDE_MAX_DISTANCE          64
+#define MARKOV_DEFAULT_ENTRIES       4096
+#define MARKOV_SUCCESSORS            2
+#define FAULT_AROUND_MAX_PAGES       512
+#define TIER_DEFAULT_FAST_NS         80.0
+#define TIER_DEFAULT_SLOW_NS         300.0
+#define TIER_DEFAULT_MIGRATION_NS    2000.0
+#define TIER_DEFAULT_PROMOTE_COUNT   4
+#define TIER_EPOCH_ACCESSES          65536
+#define NUMA_MAX_NODES               64
+#define NUMA_DEFAULT_LOCAL_NS        80.0
+#define NUMA_DEFAULT_REMOTE_NS       140.0
+#define NUMA_DEFAULT_QUANTUM         10000
+#define NUMA_MIGRATE_SCAN            64
+#define CACHE_LEVELS                 3
+#define CACHE_MAX_LINE_SIZE          4096
+#define CACHE_SPEC_MAX_LENGTH        64
+#define PAGE_TABLE_LEVEL_BITS        9
+#define PAGE_WALK_MAX_LEVELS         5
+#define PAGE_READ                    0x01
+#define PAGE_WRITE                   0x02
+#define PAGE_EXECUTE                 0x04
+#define PAGE_VALID                   0x08
+#define PAGE_GUARD                   0x10
+#define REGION_MAX_COUNT             64
+#define NO_PROTECTION_FAULT          -1
+#define REGION_SPEC_MAX_LENGTH       128
+#define HISTOGRAM_BUCKETS            ((HISTOGRAM_MAX_VALUE_BITS - HISTOGRAM_SUB_BUCKET_BITS + 2) << (HISTOGRAM_SUB_BUCKET_BITS - 1))
 
  /** STRUCT: VirtualAddress
 * A data type that represents a virtual/logical address
-* with an integer address, a page number, and a page offset.
+* with an integer address, a page number, a page offset,
+* and the protection bits the access needs (PAGE_VALID
+* with PAGE_READ, PAGE_WRITE or PAGE_EXECUTE). Once it is
+* translated it also holds the physical address and value,
+* or the ProtectionFault that refused it (NO_PROTECTION_FAULT
+* if none), until the batch is written out.
 * */
 struct VirtualAddress {
-    int address;
-    int page_number;
+    uint64_t address;
+    uint64_t page_number;
     int page_offset;
+    int access;
+    uint64_t physical_address;
+    int value;
+    int protection_fault;
 } typedef VirtualAddress;
 
 /** STRUCT: Physical Address
@@ -34,7 +133,7 @@ struct VirtualAddress {
  * a frame offset, and the value in the address.
  * */
 struct PhysicalAddress {
-    int address;
+    uint64_t address;
     int frame_number;
     int frame_offset;
     signed char value;
@@ -42,261 +141,6496 @@ struct PhysicalAddress {
 
 /** STRUCT: Virtual Memory
  * A data type that represents a list of
- * logical addresses and how many there are.
+ * logical addresses and how many there are,
+ * and whether they are read from a binary trace.
  * */
 struct VirtualMemory {
     int address_count;
+    int address_capacity;
+    int binary;
     VirtualAddress* addresses;
 } typedef VirtualMemory;
 
+/**
+ * STRUCT: ReplacementPolicy
+ * A page replacement policy, chosen by name. A policy tracks the frames
+ * through three operations: access() on every page table hit (may be NULL
+ * when the policy ignores hits), install() after a page is loaded into a
+ * frame, and victim() to choose the frame to reuse when memory is full.
+ * report() (may be NULL) prints policy-specific statistics after a run.
+ * */
+struct ReplacementPolicy {
+    const char* name;
+    void* state;
+    void (*access)(void* state, int frame_number, uint64_t page_number);
+    void (*install)(void* state, int frame_number, uint64_t page_number);
+    int (*victim)(void* state);
+    void (*report)(void* state, FILE* stream);
+} typedef ReplacementPolicy;
+
+/**
+ * STRUCT: Prefetcher
+ * A page prefetcher, chosen by name. predict() is called after every
+ * translation with the page and whether it missed (a demand fault, or
+ * the first use of a prefetched page, which would have faulted without
+ * the prefetcher); it fills in up to max_pages pages to load ahead and
+ * returns how many. The simulator loads those pages into free or victim
+ * frames and keeps the effectiveness counters:
+ * - issued: pages loaded ahead of use
+ * - useful: prefetched pages used before being evicted
+ * - unused: prefetched pages evicted without being used
+ * - polluting_faults: demand faults on pages evicted to make room for
+ *   a prefetch
+ * */
+struct Prefetcher {
+    const char* name;
+    void* state;
+    int (*predict)(void* state, uint64_t page_number, int missed, uint64_t* pages, int max_pages);
+    int degree;
+    unsigned char* frame_prefetched;
+    uint64_t* evicted_pages;
+    uint64_t issued;
+    uint64_t useful;
+    uint64_t unused;
+    uint64_t polluting_faults;
+} typedef Prefetcher;
+
+/**
+ * STRUCT: FrameList
+ * A doubly-linked list of frames, most recently used at the head. The
+ * links live in prev/next arrays indexed by frame number that can be
+ * shared by several lists, since a frame is in at most one at a time.
+ * */
+struct FrameList {
+    int head;
+    int tail;
+    int size;
+    int* prev;
+    int* next;
+} typedef FrameList;
+
+/**
+ * STRUCT: PageIndex
+ * An open-addressing hash table from page numbers to entry numbers, for
+ * policy metadata and caches that keep pages by entry. The page numbers
+ * themselves stay in the owner's entry array; the table holds at least
+ * twice as many slots as there are entries so probes stay short.
+ * */
+struct PageIndex {
+    int* slots;
+    int bits;
+} typedef PageIndex;
+
+/**
+ * STRUCT: PageCache
+ * Pages that were evicted from their frames but whose contents are
+ * still in memory, like the kernel's page and swap caches. A fault on a
+ * cached page is a minor fault: the page is copied back into a frame
+ * without reading the backing store. The cache is exclusive (a page is
+ * either in a frame or cached) and drops its least recently cached page
+ * when full. Slots are found by page through a PageIndex.
+ * */
+struct PageCache {
+    int capacity;
+    int free_slot;
+    uint64_t* pages;
+    signed char* space;
+    FrameList lru;
+    PageIndex index;
+} typedef PageCache;
+
+/**
+ * STRUCT: MemoryTiers
+ * Splits the frames into a fast tier (DRAM) and a slow tier (CXL or
+ * persistent memory), each with its own access latency. Pages fill the
+ * fast frames first. Each frame counts the sampled accesses to its
+ * page, halved every TIER_EPOCH_ACCESSES accesses (lazily, when the
+ * frame is next looked at). A slow page whose count reaches
+ * promote_threshold is promoted and exchanged with a cold fast page,
+ * found by a clock hand over the fast frames that halves the counts of
+ * the hot pages it passes. Since the replacement policy knows pages by
+ * frame number, a migration swaps the tiers of the two frames instead
+ * of moving the pages between frames; the frame number stays the
+ * page's handle.
+ * */
+enum MemoryTier {
+    TIER_FAST,
+    TIER_SLOW
+} typedef MemoryTier;
+
+struct MemoryTiers {
+    int fast_count;
+    int slow_count;
+    double fast_latency;
+    double slow_latency;
+    double migration_cost;
+    int promote_threshold;
+    int sample_interval;
+    int demotion_hand;
+    unsigned char* frame_tiers;
+    int* tier_positions;
+    int* fast_frames;
+    int* slow_frames;
+    uint16_t* heat;
+    uint32_t* heat_epochs;
+    uint64_t access_index;
+    uint64_t accesses[2];
+    uint64_t promotions;
+} typedef MemoryTiers;
+
+/**
+ * STRUCT: NumaMemory
+ * Splits the frames into NUMA nodes and runs the trace on simulated
+ * CPUs, each with a home node; the CPUs take turns of quantum accesses.
+ * Free frames are handed out per node under the allocation policy, and
+ * an access is local when the frame is on the home node of the CPU.
+ * With balancing, one access in scan_period takes a hinting fault that
+ * records which node used the frame, and a page that takes two hinting
+ * faults in a row from the same remote node is migrated there. As with
+ * the memory tiers, a migration swaps the nodes of two frames (into a
+ * free frame, or with a page not last used from the target node) so
+ * that the frame number stays the page's handle. Each node's frames are
+ * listed in node_frames, the used ones before the free ones.
+ * */
+enum NumaPolicy {
+    NUMA_LOCAL,
+    NUMA_INTERLEAVE,
+    NUMA_PREFERRED
+} typedef NumaPolicy;
+
+struct NumaMemory {
+    int node_count;
+    int cpu_count;
+    NumaPolicy policy;
+    int preferred_node;
+    int interleave_next;
+    int cpu;
+    int home_node;
+    uint64_t quantum;
+    uint64_t quantum_left;
+    uint64_t scan_period;
+    uint64_t scan_left;
+    double local_latency;
+    double remote_latency;
+    double migration_cost;
+    unsigned char* frame_nodes;
+    signed char* frame_last_nodes;
+    int* frame_positions;
+    int* node_frames;
+    int node_first[NUMA_MAX_NODES + 1];
+    int node_used[NUMA_MAX_NODES];
+    int node_hands[NUMA_MAX_NODES];
+    uint64_t node_accesses[NUMA_MAX_NODES];
+    uint64_t local_accesses;
+    uint64_t remote_accesses;
+    uint64_t hinting_faults;
+    uint64_t migrations;
+    uint64_t failed_migrations;
+} typedef NumaMemory;
+
+/**
+ * STRUCT: CacheGeometry
+ * The size, associativity and line size of one cache level. A size of
+ * zero leaves the level out.
+ * */
+struct CacheGeometry {
+    uint64_t size;
+    int ways;
+    int line_size;
+} typedef CacheGeometry;
+
+/**
+ * STRUCT: CacheLevel
+ * One set-associative cache level with LRU replacement within each set.
+ * Every line holds the line address it caches (UINT64_MAX when empty)
+ * and the time of its last use, both stored set by set. Misses are
+ * classified against a shadow fully-associative LRU cache of the same
+ * number of lines and a bitmap of the lines ever brought in: a miss on
+ * a line never seen is compulsory, one the shadow cache also misses is
+ * a capacity miss, and the rest are conflict misses, caused only by the
+ * set mapping.
+ * */
+struct CacheLevel {
+    const char* name;
+    CacheGeometry geometry;
+    int line_bits;
+    uint64_t set_mask;
+    uint64_t* tags;
+    uint64_t* stamps;
+    uint64_t clock;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t compulsory_misses;
+    uint64_t capacity_misses;
+    uint64_t* shadow_lines;
+    int shadow_free;
+    FrameList shadow_lru;
+    PageIndex shadow_index;
+    uint64_t* seen_lines;
+} typedef CacheLevel;
+
+/**
+ * STRUCT: CacheHierarchy
+ * The cache levels every translated physical address is looked up in,
+ * from L1 outwards; a miss in one level goes on to the next and fills
+ * the line into every level it missed in. Accesses that miss in every
+ * level go to memory.
+ * */
+struct CacheHierarchy {
+    int level_count;
+    CacheLevel levels[CACHE_LEVELS];
+    uint64_t memory_accesses;
+} typedef CacheHierarchy;
+
+/**
+ * STRUCT: PageColoring
+ * Free frames kept in one list per cache color, the color of a frame
+ * being its set-index bits above the page offset (the frame number
+ * modulo the number of colors). A page is given a free frame of its own
+ * color, its page number modulo the number of colors, so consecutive
+ * virtual pages land in different cache sets; if that color has run
+ * out, the next color with a free frame is used. Once memory is full the
+ * victim is the least recently used page of the wanted color, from one
+ * recency list of used frames per color, so the placement holds in the
+ * steady state too.
+ * */
+struct PageColoring {
+    int color_count;
+    int wanted_color;
+    int* color_heads;
+    int* next_free;
+    FrameList* color_lists;
+    uint64_t placements;
+    uint64_t fallbacks;
+} typedef PageColoring;
+
 /** STRUCT: Physical Address
  * A data type that represents a list of physical
  * addresses, how many there are, and a pointer to
  * the beginning of the actual physical address space.
  * Also includes an index tracker to track the next
- * available frame within the physical memory space.
+ * available frame within the physical memory space,
+ * the page held by each frame, the replacement policy
+ * that picks a frame to reuse once memory is full, the
+ * optional prefetcher, page cache and fault-around window
+ * (with a flag per frame mapped by fault-around and not
+ * used yet), the optional memory tiers, NUMA nodes, CPU caches
+ * and page coloring, and how many pages have been evicted.
  * */
 struct PhysicalMemory {
-    int address_count;
+    uint64_t address_count;
+    uint64_t eviction_count;
+    int frame_count;
     signed char* space;
-    unsigned char next_available_frame_index;
+    int next_available_frame_index;
+    int64_t* frame_pages;
     PhysicalAddress* addresses;
+    ReplacementPolicy* policy;
+    Prefetcher* prefetcher;
+    PageCache* page_cache;
+    int fault_around_pages;
+    unsigned char* frame_faulted_around;
+    MemoryTiers* tiers;
+    NumaMemory* numa;
+    CacheHierarchy* caches;
+    PageColoring* coloring;
 } typedef PhysicalMemory;
 
+/**
+ * STRUCT: PageHeat
+ * Compact per-page counters for the heatmap: accesses, faults and
+ * evictions in the current time window, the window they belong to,
+ * and the index of the page's last access in the whole trace.
+ * */
+struct PageHeat {
+    uint32_t accesses;
+    uint32_t faults;
+    uint32_t evictions;
+    uint32_t window;
+    uint64_t last_access;
+} typedef PageHeat;
+
+/**
+ * STRUCT: Heatmap
+ * Per-page counters kept alongside the page table, written out as one
+ * row per (window, page) for every page active in each window of
+ * window_size translations. The pages touched in the current window
+ * are listed so that closing a window only visits those pages.
+ * */
+struct Heatmap {
+    PageHeat* pages;
+    uint64_t window_size;
+    uint64_t window;
+    uint64_t window_position;
+    uint64_t access_index;
+    uint64_t* touched_pages;
+    uint64_t touched_count;
+    uint64_t touched_capacity;
+    FILE* file;
+    int binary;
+} typedef Heatmap;
+
+/**
+ * ENUM: VirtualizationMode
+ * How guest virtual addresses are translated when the trace runs in a
+ * virtual machine.
+ * */
+enum VirtualizationMode {
+    VIRTUALIZATION_NONE,
+    VIRTUALIZATION_NESTED,
+    VIRTUALIZATION_SHADOW
+} typedef VirtualizationMode;
+
+struct PageTable;
+
+/**
+ * STRUCT: Region
+ * A range of virtual addresses [start, end) with the protection of its
+ * pages. Code is readable and executable, heap and stack are readable
+ * and writable, and guard pages are valid but cannot be accessed at
+ * all, unless other permissions are given.
+ * */
+enum RegionKind {
+    REGION_CODE,
+    REGION_HEAP,
+    REGION_STACK,
+    REGION_GUARD
+} typedef RegionKind;
+
+struct Region {
+    RegionKind kind;
+    uint64_t start;
+    uint64_t end;
+    int protection;
+} typedef Region;
+
+/**
+ * ENUM: ProtectionFault
+ * Why an access was refused: its page is outside the address space or
+ * any region, is a guard page, or does not allow the kind of access.
+ * */
+enum ProtectionFault {
+    PROTECTION_UNMAPPED,
+    PROTECTION_GUARD,
+    PROTECTION_READ,
+    PROTECTION_WRITE,
+    PROTECTION_EXECUTE,
+    PROTECTION_FAULT_KINDS
+} typedef ProtectionFault;
+
+/**
+ * STRUCT: PageWalkCache
+ * Caches of the upper-level entries of a radix page table (PML4, PDPT
+ * and PD style), one small LRU cache per level, each indexed by the
+ * prefix of the virtual page number that selects an entry at that
+ * level. A walk starts below the deepest level that hits, skipping the
+ * memory references to the levels above it, and fills every level.
+ * Level 0 is the root.
+ * */
+struct PageWalkCache {
+    int levels;
+    int entries;
+    uint64_t* tags;
+    uint64_t* stamps;
+    uint64_t clock;
+    uint64_t walks;
+    uint64_t skipped_levels;
+    uint64_t level_hits[PAGE_WALK_MAX_LEVELS];
+} typedef PageWalkCache;
+
+/**
+ * STRUCT: VirtualMachine
+ * A guest in front of the page table, which then becomes the host page
+ * table from guest-physical pages to host frames. The guest page table
+ * maps guest virtual pages to its guest_page_count guest-physical pages,
+ * which the guest replaces with its own policy; a guest fault reads the
+ * page into a guest-physical page, and a host fault backs that page
+ * with a host frame. With nested paging every translation that misses
+ * the optional nested TLB (guest virtual page to host frame, LRU) walks
+ * both tables in two dimensions: each of the guest_levels guest entries
+ * and the final guest-physical address are themselves translated by a
+ * host_levels walk, (guest_levels + 1) * (host_levels + 1) - 1 memory
+ * references in all. With shadow paging the hypervisor instead keeps a
+ * shadow table from guest virtual pages straight to host frames, which
+ * the hardware walks like a native table. Every write to the guest page
+ * table traps and is synchronized into the shadow table, a frame taken
+ * by the host drops the shadow entry that points to it, and a missing
+ * shadow entry exits to the hypervisor, which walks the guest and host
+ * tables in software to fill it. Page walk caches, if kept, cover
+ * the guest page table under nested paging and the shadow table under
+ * shadow paging.
+ * */
+struct VirtualMachine {
+    VirtualizationMode mode;
+    struct PageTable* guest_table;
+    ReplacementPolicy* guest_policy;
+    int guest_page_count;
+    int next_guest_page;
+    int guest_levels;
+    int host_levels;
+    uint64_t translations;
+    uint64_t guest_evictions;
+    uint64_t walks;
+    uint64_t walk_references;
+    uint64_t guest_table_updates;
+    int* shadow_map;
+    uint64_t shadow_faults;
+    uint64_t shadow_syncs;
+    uint64_t shadow_invalidations;
+    int tlb_entries;
+    int tlb_free;
+    int tlb_missed;
+    uint64_t* tlb_pages;
+    uint64_t* tlb_guest_pages;
+    int* tlb_frames;
+    FrameList tlb_lru;
+    PageIndex tlb_index;
+    uint64_t tlb_hits;
+} typedef VirtualMachine;
+
 /**
  * STRUCT: PageTable
  * A data type that represents a page table with
  * mappings between indexes (page numbers) and the
  * frame number associated with that index. Also
- * tracks fault counts during mapping.
+ * tracks fault counts during mapping (minor faults are
+ * those served from the page cache without I/O), the
+ * pages mapped by fault-around and how many of them
+ * were used, and optionally the per-page heatmap counters.
+ * Under virtualization it also has the guest in front of it,
+ * and the backing store page holding the contents of each of
+ * its pages (otherwise a page is backed by its own number).
+ * The optional page walk caches model the walks of the table.
+ * With a region map it has the protection bits of every virtual
+ * page, and it counts the accesses refused by them (or by being
+ * outside the address space) apart from the page faults.
  * */
 struct PageTable {
     int* map;
-    int fault_count;
+    uint64_t page_count;
+    uint64_t fault_count;
+    uint64_t minor_fault_count;
+    uint64_t fault_around_count;
+    uint64_t fault_around_hits;
+    Heatmap* heatmap;
+    VirtualMachine* guest;
+    uint64_t* backing_pages;
+    PageWalkCache* walk_cache;
+    unsigned char* protections;
+    uint64_t protection_faults[PROTECTION_FAULT_KINDS];
 } typedef PageTable;
 
-void map_addresses(VirtualMemory* virtual_memory, PhysicalMemory* physical_memory, PageTable* page_table, FILE* backing_store, FILE* output_file);
-VirtualMemory* create_virtual_memory(FILE* file_input);
-PhysicalMemory* create_physical_memory();
-PageTable* create_page_table();
+/**
+ * STRUCT: BackingStore
+ * A data type that represents the backing store file.
+ * Pages are read with pread() at 64-bit offsets, or copied
+ * straight out of a read-only mapping of the whole file.
+ * */
+struct BackingStore {
+    int fd;
+    uint64_t size;
+    signed char* mapping;
+} typedef BackingStore;
 
 /**
- * ENTRY POINT: The main entry point of the program
+ * STRUCT: Options
+ * The command line configuration of a simulation run: the input
+ * trace, the output and backing store files, and the geometry of
+ * the simulated memory.
  * */
-int main(int argc, char* argv[]) {
+struct Options {
+    const char* input_path;
+    const char* backing_store_path;
+    int address_bits;
+    int frame_count;
+    int use_mmap;
+    const char* policy_name;
+    const char* output_path;
+    int timings;
+    int perf_counters;
+    int latency_histograms;
+    const char* histogram_path;
+    const char* trace_events_path;
+    uint64_t trace_events_capacity;
+    const char* live_statistics_name;
+    const char* heatmap_path;
+    uint64_t heatmap_window;
+    int heatmap_binary;
+    int hot_pages;
+    uint64_t hot_pages_counters;
+    const char* prefetcher_name;
+    int prefetch_degree;
+    int prefetch_table;
+    int page_cache_pages;
+    int fault_around_pages;
+    int slow_frame_count;
+    double fast_latency;
+    double slow_latency;
+    double migration_cost;
+    int promote_threshold;
+    int tier_sample_interval;
+    int numa_node_count;
+    int numa_cpu_count;
+    NumaPolicy numa_policy;
+    int numa_preferred_node;
+    uint64_t numa_quantum;
+    uint64_t numa_balancing_period;
+    double local_latency;
+    double remote_latency;
+    int caches;
+    CacheGeometry cache_levels[CACHE_LEVELS];
+    int page_coloring;
+    int page_colors;
+    VirtualizationMode virtualization;
+    int guest_page_count;
+    const char* guest_policy_name;
+    int nested_tlb_entries;
+    int walk_cache_entries;
+    int region_count;
+    Region regions[REGION_MAX_COUNT];
+} typedef Options;
 
-    /// Show error message if the count of required arguments is incorrect.
-    if (argc != 2) {
-        printf("Usage: %s addresses.txt\n", argv[0]);
-        exit(0);
-    }
+/**
+ * ENUM: LoadReason
+ * Why a page is being loaded into a frame.
+ * */
+enum LoadReason {
+    LOAD_DEMAND,
+    LOAD_PREFETCH,
+    LOAD_FAULT_AROUND
+} typedef LoadReason;
 
-    /// Open the input file, the output file, and the backing store.
-    FILE* file_input = fopen(argv[1], "r");
-    FILE* file_output = fopen("output.txt", "w");
-    FILE* file_backing_store = fopen("BACKING_STORE.bin", "rb");
+/**
+ * STRUCT: SimulationResult
+ * The totals of a simulation run, for callers that run the
+ * simulator programmatically such as the throughput benchmark.
+ * */
+struct SimulationResult {
+    uint64_t address_count;
+    uint64_t fault_count;
+} typedef SimulationResult;
 
-    /// Generate error checking message depending on the file open state.
-    if (file_input == NULL) {
-        printf("Error: unable to open %s\n", argv[1]);
-        exit(-1);
-    }
+/**
+ * STRUCT: LiveStatistics
+ * Running counters of a simulation, published in a shared memory segment
+ * so that "vmm watch" can follow a long run from another process. The
+ * counters are guarded by a seqlock: the simulator makes the sequence odd
+ * while it updates them and even again afterwards, and a reader retries
+ * until it sees the same even sequence before and after its copy. The
+ * simulator never waits for readers. When the run is in a virtual machine
+ * with a nested TLB, tlb_entries is its size and tlb_hits is published
+ * too; otherwise tlb_entries is 0.
+ * */
+struct LiveStatistics {
+    uint64_t magic;
+    uint64_t tlb_entries;
+    _Atomic uint64_t sequence;
+    _Atomic uint64_t address_count;
+    _Atomic uint64_t fault_count;
+    _Atomic uint64_t eviction_count;
+    _Atomic uint64_t tlb_hits;
+    _Atomic uint64_t start_time_ns;
+    _Atomic uint64_t update_time_ns;
+    _Atomic uint64_t finished;
+} typedef LiveStatistics;
 
-    if (file_output == NULL) {
-        printf("Error: unable to open output.txt\n");
-        exit(-2);
-    }
+/**
+ * ENUM: Phase
+ * The phases of a simulation run that are timed separately.
+ * */
+enum Phase {
+    PHASE_OPEN,
+    PHASE_PARSE,
+    PHASE_SETUP,
+    PHASE_TRANSLATE,
+    PHASE_FAULT,
+    PHASE_OUTPUT,
+    PHASE_COUNT
+} typedef Phase;
 
-    if (file_backing_store == NULL) {
-        printf("Error: unable to open the backing store 'BACKING_STORE.bin'\n");
-        exit(-3);
-    }
+static const char* phase_names[PHASE_COUNT] = { "file open", "parse", "page table setup", "translation", "fault service", "output" };
 
-    /// Create a virtual memory struct using the input addresses.
-    VirtualMemory* virtual_memory = create_virtual_memory(file_input);
+/**
+ * ENUM: EventType
+ * The kinds of events the event recorder keeps: a phase interval,
+ * a page fault (with its duration) and the eviction of a page.
+ * */
+enum EventType {
+    EVENT_PHASE,
+    EVENT_FAULT,
+    EVENT_EVICTION
+} typedef EventType;
 
-    /// Create an empty physical memory space with no pages in it.
-    PhysicalMemory* physical_memory = create_physical_memory();
+/**
+ * STRUCT: Event
+ * One recorded event: when it started (in timestamp ticks), how long it
+ * took, and two arguments whose meaning depends on the type (the phase,
+ * or the page and frame numbers).
+ * */
+struct Event {
+    uint64_t ticks;
+    uint64_t duration;
+    uint64_t page_number;
+    int32_t argument;
+    uint32_t type;
+} typedef Event;
 
-    /// Create a page table with unmapped frames.
-    PageTable* page_table = create_page_table();
+/**
+ * STRUCT: EventRing
+ * A single-producer, single-consumer lock-free ring of events. Each
+ * thread that records events gets its own ring, so producers never
+ * contend: only the owning thread advances head, and only the thread
+ * draining the ring advances tail. When the ring is full new events are
+ * dropped and counted rather than blocking the simulator.
+ * */
+struct EventRing {
+    _Atomic uint64_t head;
+    _Atomic uint64_t tail;
+    uint64_t capacity;
+    uint64_t dropped;
+    int thread_id;
+    Event* events;
+    struct EventRing* next;
+} typedef EventRing;
 
-    /// Implement the demand paging algorithm, translating each virtual address
-    /// to a physical address and then bring in missing pages from the backing store
-    /// then output the result to the file "output.txt"
-    map_addresses(virtual_memory, physical_memory, page_table, file_backing_store, file_output);
+/**
+ * STRUCT: EventRecorder
+ * The list of every thread's ring. Event timestamps are converted to
+ * microseconds for the trace file with the shared timestamp calibration.
+ * */
+struct EventRecorder {
+    int enabled;
+    uint64_t capacity;
+    _Atomic int next_thread_id;
+    _Atomic(EventRing*) rings;
+} typedef EventRecorder;
 
-    /// Close all the file descriptors
-    fclose(file_input);
-    fclose(file_output);
-    fclose(file_backing_store);
+static EventRecorder event_recorder;
+static _Thread_local EventRing* thread_event_ring;
 
-    exit(0);
-}
+void record_event(EventType type, uint64_t ticks, uint64_t duration, uint64_t page_number, int argument);
 
 /**
- * FUNCTION map_addresses()
- * Translates virtual addresses from a VirtualAddress struct into
- * physical addresses using demand paging. Outputs the result to a text file.
+ * ENUM: PerfCounter
+ * The hardware events counted with perf_event_open() when --perf-counters is set.
  * */
-void map_addresses(VirtualMemory* virtual_memory, PhysicalMemory* physical_memory, PageTable* page_table, FILE* backing_store, FILE* output_file) {
+enum PerfCounter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_COUNTER_COUNT
+} typedef PerfCounter;
 
-    /// Create a buffer for reading pages from the backing store
-    signed char* page_read_buffer = (signed char*)malloc(sizeof(signed char) * PAGE_SIZE);
+/**
+ * STRUCT: PhaseMark
+ * The timestamp (and hardware counter values) at the start of an interval.
+ * */
+struct PhaseMark {
+    uint64_t ticks;
+    uint64_t counters[PERF_COUNTER_COUNT];
+} typedef PhaseMark;
 
-    /// Resize the physical address list according to the number of available virtual addresses
-    physical_memory->addresses = realloc(physical_memory->addresses, sizeof(PhysicalAddress) * virtual_memory->address_count);
+/**
+ * STRUCT: TimestampCalibration
+ * A timestamp and a clock_gettime() time taken together at the start of
+ * a run. The phase timers, latency histograms and event recorder all
+ * convert timestamp ticks to time against this one snapshot.
+ * */
+struct TimestampCalibration {
+    uint64_t start_ticks;
+    struct timespec start_time;
+} typedef TimestampCalibration;
 
-    /// For each virtual address
-    for (int i = 0; i < virtual_memory->address_count; i++) {
+static TimestampCalibration timestamp_calibration;
 
-        /// Track the virtual address's attributes
-        int va_page_address = virtual_memory->addresses[i].address;
-        int va_page_offset = virtual_memory->addresses[i].page_offset;
-        int va_page_number = virtual_memory->addresses[i].page_number;
+/**
+ * STRUCT: PhaseTimers
+ * Accumulated timestamp ticks, interval counts and hardware counter
+ * deltas per phase. Timestamps come from the time stamp counter where
+ * there is one, and are converted to nanoseconds with the timestamp
+ * calibration taken over the run. The hardware counters are opened as
+ * one perf event group so that a single read() returns all of them;
+ * perf_slots maps each group member back to its PerfCounter.
+ * */
+struct PhaseTimers {
+    int enabled;
+    uint64_t ticks[PHASE_COUNT];
+    uint64_t counts[PHASE_COUNT];
+    int perf_fd;
+    int perf_slot_count;
+    PerfCounter perf_slots[PERF_COUNTER_COUNT];
+    uint64_t counters[PHASE_COUNT][PERF_COUNTER_COUNT];
+} typedef PhaseTimers;
 
-        /// Translate the Virtual Address into a Physical Address
-        /// The frame number is obtained from the page table[page number]
-        /// The frame offset is obtained form the page offset
-        int pa_frame_number = page_table->map[va_page_number];
-        int pa_frame_offset = va_page_offset;
+static PhaseTimers phase_timers = { .perf_fd = -1 };
 
-        /// If there is no frame number in the page table index selected
-        if (pa_frame_number == UNMAPPED) {
-            /// Add one to the fault counter
-            page_table->fault_count++;
+/**
+ * FUNCTION: read_timestamp()
+ * Returns a cheap, monotonic timestamp in ticks.
+ * */
+static inline uint64_t read_timestamp(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+#endif
+}
 
-            /// Get a free frame number from the physical memory
-            pa_frame_number = physical_memory->next_available_frame_index;
+/**
+ * FUNCTION: start_timestamp_calibration()
+ * Takes the first half of the calibration between timestamp ticks and
+ * nanoseconds.
+ * */
+static void start_timestamp_calibration(void) {
+    clock_gettime(CLOCK_MONOTONIC, &timestamp_calibration.start_time);
+    timestamp_calibration.start_ticks = read_timestamp();
+}
 
-            /// Set the next free frame for the next frame number request
-            physical_memory->next_available_frame_index++;
+/**
+ * FUNCTION: nanoseconds_per_tick()
+ * Completes the timestamp calibration. Stores the nanoseconds elapsed
+ * since it was started in elapsed (if not NULL), and returns the length
+ * of a tick in nanoseconds (0 if no ticks have passed).
+ * */
+static double nanoseconds_per_tick(double* elapsed) {
+    struct timespec end_time;
+    uint64_t end_ticks = read_timestamp();
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    double nanoseconds = (double)(end_time.tv_sec - timestamp_calibration.start_time.tv_sec) * 1e9 +
+                         (double)(end_time.tv_nsec - timestamp_calibration.start_time.tv_nsec);
+    if (elapsed != NULL) {
+        *elapsed = nanoseconds;
+    }
+    return end_ticks > timestamp_calibration.start_ticks ? nanoseconds / (double)(end_ticks - timestamp_calibration.start_ticks) : 0.0;
+}
 
-            /// Go to the backing store's location that corresponds to the missing unmapped page number
-            fseek(backing_store, va_page_number * PAGE_SIZE, SEEK_SET);
+/**
+ * STRUCT: LatencyHistogram
+ * A log-linear histogram of latencies in timestamp ticks, in the style of
+ * HdrHistogram: values below 2^HISTOGRAM_SUB_BUCKET_BITS have a bucket
+ * each, and every power of two above that is split into 2^(bits - 1)
+ * linear buckets, so each bucket is within about 3% of its values. The
+ * memory use is fixed no matter how many values are recorded.
+ * */
+struct LatencyHistogram {
+    const char* name;
+    uint64_t total_count;
+    uint64_t max_value;
+    uint64_t counts[HISTOGRAM_BUCKETS];
+} typedef LatencyHistogram;
 
-            /// Copy the contents of the backing store to the read buffer
-            fread(page_read_buffer, sizeof(signed char), PAGE_SIZE, backing_store);
-            for (int i = 0; i < PAGE_SIZE; i++) {
-                physical_memory->space[(pa_frame_number * FRAME_SIZE) + i] = page_read_buffer[i];
-            }
+/**
+ * STRUCT: LatencyHistograms
+ * The fault service and translation latency histograms of a run.
+ * */
+struct LatencyHistograms {
+    int enabled;
+    LatencyHistogram fault;
+    LatencyHistogram translation;
+} typedef LatencyHistograms;
 
-            /// Add the mapped frame number with actual page contents into the
-            /// page table map so that it can be accessed later on.
-            page_table->map[va_page_number] = pa_frame_number;
-        }
+static LatencyHistograms latency_histograms;
 
-        /// For convenience, all of the information we retrieve is stored in a Physical Address struct
-        /// and stored in a PhysicalMemory struct for later access.
+/**
+ * STRUCT: HotPageCounter
+ * One Space-Saving counter: the page it monitors, its estimated access
+ * count, the most that estimate can exceed the true count, and its
+ * position in the min-heap.
+ * */
+struct HotPageCounter {
+    uint64_t page_number;
+    uint64_t count;
+    uint64_t error;
+    uint32_t heap_index;
+} typedef HotPageCounter;
 
-        /// Create a new physical address
-        PhysicalAddress* physical_address = (PhysicalAddress*)malloc(sizeof(PhysicalAddress));
+/**
+ * STRUCT: HotPages
+ * A Space-Saving heavy-hitters tracker over page numbers, in fixed
+ * memory however large the address space. The counters are kept in a
+ * min-heap by count and found through an open-addressing hash table,
+ * so each access costs O(log counter_count). Any page accessed more
+ * than address_count / counter_count times is guaranteed to be tracked.
+ * */
+struct HotPages {
+    int enabled;
+    int top_count;
+    uint32_t counter_count;
+    uint32_t used_count;
+    uint64_t address_count;
+    HotPageCounter* counters;
+    uint32_t* heap;
+    uint32_t* table;
+    int table_bits;
+} typedef HotPages;
 
-        /// Add the frame number and the offset we got earlier
-        physical_address->frame_number = pa_frame_number;
-        physical_address->frame_offset = pa_frame_offset;
+static HotPages hot_pages;
 
-        /// Generate the address by combining the frame number and the frame offset using bit shift and bitwise OR
-        physical_address->address = (physical_address->frame_number << FRAME_NUMBER_OFFSET_BITS) | physical_address->frame_offset;
+/**
+ * FUNCTION: record_latency()
+ * Adds one value to a histogram.
+ * */
+static inline void record_latency(LatencyHistogram* histogram, uint64_t value) {
+    int index;
+    if (value < (1ULL << HISTOGRAM_SUB_BUCKET_BITS)) {
+        index = (int)value;
+    } else {
+        int shift = 63 - __builtin_clzll(value) - (HISTOGRAM_SUB_BUCKET_BITS - 1);
+        index = (shift << (HISTOGRAM_SUB_BUCKET_BITS - 1)) + (int)(value >> shift);
+        if (index >= HISTOGRAM_BUCKETS) {
+            index = HISTOGRAM_BUCKETS - 1;
+        }
+    }
+    histogram->counts[index]++;
+    histogram->total_count++;
+    if (value > histogram->max_value) {
+        histogram->max_value = value;
+    }
+}
 
-        /// Obtain the value of associated address from the space using the frame number, offset, and page size,
-        /// since it is guaranteed to have a page there now from demanding it earlier if it is missing
-        physical_address->value = physical_memory->space[pa_frame_offset + (pa_frame_number * PAGE_SIZE)];
-        physical_memory->addresses[pa_frame_number] = (*physical_address);
+void read_perf_counters(uint64_t* counters);
 
-        /// Increase the address count within the physical memory (for debug and error checking).
-        physical_memory->address_count++;
+/**
+ * FUNCTION: begin_phase() / end_phase()
+ * Record the start of an interval, and add the interval to a phase.
+ * */
+static inline void begin_phase(PhaseMark* mark) {
+    if (phase_timers.perf_fd >= 0) {
+        read_perf_counters(mark->counters);
+    }
+    mark->ticks = read_timestamp();
+}
 
-        /// Output each translation, mapping, and associated value into the output file
-        fprintf(output_file, "Virtual address: %d Physical address: %d Value: %d\n", va_page_address, physical_memory->addresses[pa_frame_number].address, physical_memory->addresses[pa_frame_number].value);
+static inline void end_phase(Phase phase, PhaseMark* mark) {
+    uint64_t duration = read_timestamp() - mark->ticks;
+    phase_timers.ticks[phase] += duration;
+    phase_timers.counts[phase]++;
+    if (event_recorder.enabled && phase != PHASE_FAULT) {
+        record_event(EVENT_PHASE, mark->ticks, duration, 0, phase);
+    }
+    if (phase_timers.perf_fd >= 0) {
+        uint64_t counters[PERF_COUNTER_COUNT];
+        read_perf_counters(counters);
+        for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+            phase_timers.counters[phase][i] += counters[i] - mark->counters[i];
+        }
     }
+}
 
-    /// Output the final statistics into the output file
-    fprintf(output_file, "Page Faults = %d\n", page_table->fault_count);
-    fprintf(output_file, "Page Fault Rate = %.3f\n", (float)page_table->fault_count / (float)virtual_memory->address_count);
-    printf("Successfully generated output file 'output.txt'\n");
+/// PHASE_BEGIN() returns the mark of a new interval, as in
+/// "PhaseMark timer = PHASE_BEGIN();", and PHASE_END adds it to a phase.
+/// When the timers are off this costs one well-predicted branch.
+#if VMM_PHASE_TIMERS
+static inline PhaseMark phase_begin(void) {
+    PhaseMark mark = { 0 };
+    if (__builtin_expect(phase_timers.enabled, 0)) {
+        begin_phase(&mark);
+    }
+    return mark;
 }
+#define PHASE_BEGIN() phase_begin()
+#define PHASE_END(phase, timer) do { \
+        if (__builtin_expect(phase_timers.enabled, 0)) { \
+            end_phase(phase, &(timer)); \
+        } \
+    } while (0)
+#else
+#define PHASE_BEGIN() ((PhaseMark){ 0 })
+#define PHASE_END(phase, timer) do { (void)(timer); } while (0)
+#endif
 
 /**
- * FUNCTION create_virtual_memory()
- * Creates a virtual memory space, with a list of virtual addresses
- * and their extracted page number and page offsets from an input file
- * containing a variable amount of virtual addresses.
-*/
-VirtualMemory* create_virtual_memory(FILE* file_input) {
+ * ENUM: TraceModel
+ * The access patterns the trace generator can produce. Each model
+ * decides which page the next reference touches; the offset within
+ * the page is always drawn uniformly at random.
+ * */
+enum TraceModel {
+    TRACE_MODEL_UNIFORM,
+    TRACE_MODEL_ZIPF,
+    TRACE_MODEL_SEQUENTIAL,
+    TRACE_MODEL_LOOP,
+    TRACE_MODEL_STRIDE,
+    TRACE_MODEL_CHASE,
+    TRACE_MODEL_MIX
+} typedef TraceModel;
 
-    /// Create a new virtual memory space
-    VirtualMemory* new_virtual_memory = (VirtualMemory*)malloc(sizeof(VirtualMemory));
-    new_virtual_memory->address_count = 0;
+/**
+ * STRUCT: Random
+ * A xoshiro256** pseudo random number generator. It is seeded through
+ * splitmix64 so that a single 64-bit seed reproduces the same trace.
+ * */
+struct Random {
+    uint64_t state[4];
+} typedef Random;
 
-    /// Set buffers for reading a line from the input file
-    char  buffer_char;
-    char* buffer_line_chars = malloc(sizeof(char));
-    int   buffer_line_index = 0;
+/**
+ * STRUCT: TraceGenerator
+ * A data type that represents one access pattern over an address
+ * space of page_count pages, along with the state each model needs
+ * to produce its next page number. A mix generator owns a list of
+ * sub-generators and switches between them every phase_length references.
+ * */
+struct TraceGenerator {
+    TraceModel model;
+    uint64_t page_count;
+    uint64_t position;
 
-    /// Scan each character until the end of the file.
-    while ((buffer_char = getc(file_input)) != EOF) {
+    /// Zipf: skew and the precomputed rejection-inversion constants.
+    double zipf_skew;
+    double zipf_h_integral_x1;
+    double zipf_h_integral_n;
+    double zipf_s;
 
-        if (buffer_char != '\n') {
-            /// If within a line, store the characters in the line buffer
-            buffer_line_chars = realloc(buffer_line_chars, sizeof(char) * (buffer_line_index + 1));
-            buffer_line_chars[buffer_line_index] = buffer_char;
-            buffer_line_index++;
+    /// Loop and stride: the working set size and the step in pages.
+    uint64_t loop_pages;
+    uint64_t stride_pages;
 
+    /// Pointer chase: a single cycle through every page.
+    uint64_t* chase_next;
 
-        } else if (buffer_char == '\n') {
-            /// If at the end of the line, create a new virtual address from the contents
-            VirtualAddress* new_address = (VirtualAddress*)malloc(sizeof(VirtualAddress));
-            /// Convert the characters to integers
-            new_address->address = atoi(buffer_line_chars);
-            /// Get the page number by shifting the bits a set size
-            new_address->page_number = new_address->address >> PAGE_NUMBER_OFFSET_BITS;
-            /// Get the page offset by masking the leftmost bits a set size
-            new_address->page_offset = new_address->address & PAGE_OFFSET_MASK;
-            /// Resize the address list to accomodate the new address
-            new_virtual_memory->addresses = realloc(new_virtual_memory->addresses, sizeof(VirtualAddress) * (new_virtual_memory->address_count + 1));
-            /// Add the newly created address to the virtual memory's address list
-            new_virtual_memory->addresses[new_virtual_memory->address_count] = (*new_address);
-            /// Increase the count of addresses.
-            new_virtual_memory->address_count++;
+    /// Phase mixture: the models to cycle through and the phase length.
+    struct TraceGenerator* phases[TRACE_MAX_MIX_MODELS];
+    int phase_count;
+    int phase_index;
+    uint64_t phase_length;
+    uint64_t phase_position;
+} typedef TraceGenerator;
 
-            /// Reset the line buffer for the next line.
-            for (int i = 0; i < (buffer_line_index + 1); i++) {
-                buffer_line_chars[i] = 0;
-            }
-            buffer_line_index = 0;
-        }
-    }
-    /// Return the pointer to the new virtual memory.
-    return new_virtual_memory;
-}
+void map_addresses(VirtualMemory* virtual_memory, PhysicalMemory* physical_memory, PageTable* page_table, BackingStore* backing_store);
+void write_translations(VirtualMemory* virtual_memory, FILE* output_file);
+void report_statistics(PhysicalMemory* physical_memory, PageTable* page_table, FILE* output_file);
+int run_simulation(Options* options, SimulationResult* result);
+void start_phase_timers();
+void report_phase_timers(uint64_t address_count);
+int open_perf_counters();
+void close_perf_counters();
+void start_latency_histograms();
+void report_latency_histograms(const char* export_path);
+uint64_t histogram_bucket_low(int index);
+uint64_t histogram_percentile(LatencyHistogram* histogram, double percentile);
+void start_event_recording(uint64_t capacity);
+int write_trace_events(const char* path);
+LiveStatistics* create_live_statistics(const char* name, int tlb_entries);
+void publish_live_statistics(LiveStatistics* live_statistics, PhysicalMemory* physical_memory, PageTable* page_table, int finished);
+int watch_live_statistics(int argc, char* argv[]);
+Heatmap* create_heatmap(uint64_t page_count, uint64_t window_size, const char* path, int binary);
+PageHeat* touch_page_heat(Heatmap* heatmap, uint64_t page_number);
+void record_page_access(Heatmap* heatmap, uint64_t page_number, int faulted);
+void close_heatmap_window(Heatmap* heatmap);
+int close_heatmap(Heatmap* heatmap);
+int start_hot_pages(int top_count, uint64_t counter_count);
+void record_hot_page(uint64_t page_number);
+void report_hot_pages();
+VirtualMemory* create_virtual_memory(FILE* file_input);
+VirtualMemory* open_virtual_memory(FILE* file_input);
+int read_virtual_memory(VirtualMemory* virtual_memory, FILE* file_input, int max_count);
+VirtualAddress* append_virtual_address(VirtualMemory* virtual_memory);
+PhysicalMemory* create_physical_memory(int frame_count);
+PageTable* create_page_table(uint64_t page_count);
+int service_page_fault(PhysicalMemory* physical_memory, PageTable* page_table, BackingStore* backing_store, uint64_t page_number);
+int load_page(PhysicalMemory* physical_memory, PageTable* page_table, BackingStore* backing_store, uint64_t page_number, LoadReason reason);
+void fault_around(PhysicalMemory* physical_memory, PageTable* page_table, BackingStore* backing_store, uint64_t page_number);
+PageCache* create_page_cache(int capacity);
+int page_is_cached(PageCache* page_cache, uint64_t page_number);
+int take_cached_page(PageCache* page_cache, uint64_t page_number, signed char* destination);
+void cache_evicted_page(PageCache* page_cache, uint64_t page_number, const signed char* source);
+void report_page_cache(PhysicalMemory* physical_memory, PageTable* page_table, FILE* stream);
+MemoryTiers* create_memory_tiers(int frame_count, Options* options);
+void record_tier_access(MemoryTiers* tiers, int frame_number);
+void report_memory_tiers(MemoryTiers* tiers, FILE* stream);
+NumaMemory* create_numa_memory(int frame_count, Options* options);
+int allocate_numa_frame(NumaMemory* numa);
+void record_numa_access(NumaMemory* numa, int frame_number);
+void report_numa_memory(NumaMemory* numa, FILE* stream);
+int parse_cache_geometry(const char* text, CacheGeometry* geometry);
+CacheHierarchy* create_cache_hierarchy(Options* options);
+void access_caches(CacheHierarchy* caches, uint64_t address);
+void invalidate_cached_frame(CacheHierarchy* caches, int frame_number);
+void report_caches(CacheHierarchy* caches, FILE* stream);
+PageColoring* create_page_coloring(int frame_count, int color_count);
+ReplacementPolicy* create_colored_policy(PageColoring* coloring);
+int allocate_colored_frame(PageColoring* coloring, uint64_t page_number);
+void report_page_coloring(PhysicalMemory* physical_memory, FILE* stream);
+int page_table_levels(uint64_t page_count);
+VirtualMachine* create_virtual_machine(Options* options, uint64_t page_count);
+uint64_t translate_guest_page(PhysicalMemory* physical_memory, PageTable* page_table, BackingStore* backing_store, uint64_t page_number);
+int service_guest_fault(PhysicalMemory* physical_memory, PageTable* page_table, BackingStore* backing_store, uint64_t page_number);
+void complete_guest_translation(VirtualMachine* virtual_machine, uint64_t page_number, uint64_t guest_page_number, int frame_number);
+void invalidate_shadow_page(PageTable* page_table, uint64_t guest_page_number);
+void report_virtual_machine(PageTable* page_table, FILE* stream);
+PageWalkCache* create_page_walk_cache(int levels, int entries);
+int walk_page_table(PageWalkCache* walk_cache, uint64_t page_number);
+void report_page_walk_cache(PageWalkCache* walk_cache, int level_references, FILE* stream);
+int parse_region(const char* text, Region* region);
+unsigned char* create_protections(uint64_t page_count, Region* regions, int region_count);
+void record_protection_fault(PageTable* page_table, VirtualAddress* virtual_address);
+void report_protection_faults(PageTable* page_table, FILE* stream);
+void prefetch_pages(PhysicalMemory* physical_memory, PageTable* page_table, BackingStore* backing_store, uint64_t page_number, int missed);
+Prefetcher* create_prefetcher(const char* name, int frame_count, uint64_t page_count, int degree, int table_size);
+void report_prefetcher(Prefetcher* prefetcher, uint64_t fault_count, FILE* stream);
+Prefetcher* create_stride_prefetcher(int table_size);
+Prefetcher* create_markov_prefetcher(int table_size);
+ReplacementPolicy* create_replacement_policy(const char* name, int frame_count);
+BackingStore* create_backing_store(const char* path, int use_mmap);
+void read_backing_store_page(BackingStore* backing_store, uint64_t page_number, signed char* destination);
+void close_backing_store(BackingStore* backing_store);
+void set_default_options(Options* options);
+int parse_options(int argc, char* argv[], Options* options);
+int make_backing_store(int argc, char* argv[]);
+int parse_size(const char* text, uint64_t* size);
+int run_benchmarks(int argc, char* argv[]);
+int run_throughput(int argc, char* argv[]);
+int compare_output_files(const char* output_path, const char* golden_path);
+ReplacementPolicy* create_fifo_policy(int frame_count);
+ReplacementPolicy* create_lru_policy(int frame_count);
+ReplacementPolicy* create_tinylfu_policy(int frame_count);
+ReplacementPolicy* create_aging_policy(int frame_count);
+ReplacementPolicy* create_lirs_policy(int frame_count);
+ReplacementPolicy* create_clockpro_policy(int frame_count);
+ReplacementPolicy* create_lfu_policy(int frame_count);
+ReplacementPolicy* create_lfuda_policy(int frame_count);
 
 /**
- * FUNCTION: create_physical_memory()
- * Creates a Physical memory space using a predetermined size.
- * This memory space's frames is all free (There are no pages in it yet.)
+ * The replacement policies that can be chosen with --policy, by name.
  * */
-PhysicalMemory* create_physical_memory() {
-    PhysicalMemory* new_physical_memory = (PhysicalMemory*)malloc(sizeof(PhysicalMemory));
-    new_physical_memory->addresses = (PhysicalAddress*)malloc(sizeof(PhysicalAddress));
-    new_physical_memory->space = (signed char*)malloc(sizeof(signed char) * PHYSICAL_MEMORY_SIZE);
-    new_physical_memory->next_available_frame_index = 0;
-    new_physical_memory->address_count = 0;
-    return new_physical_memory;
+struct ReplacementPolicyEntry {
+    const char* name;
+    ReplacementPolicy* (*create)(int frame_count);
+} typedef ReplacementPolicyEntry;
+
+/**
+ * The prefetchers that can be chosen with --prefetch, by name. create()
+ * takes the size of the prefetcher's table, or 0 for its default.
+ * */
+struct PrefetcherEntry {
+    const char* name;
+    Prefetcher* (*create)(int table_size);
+} typedef PrefetcherEntry;
+
+static const PrefetcherEntry prefetchers[] = {
+    { "stride", create_stride_prefetcher },
+    { "markov", create_markov_prefetcher },
+    { NULL, NULL }
+};
+
+static const ReplacementPolicyEntry replacement_policies[] = {
+    { "fifo", create_fifo_policy },
+    { "lru", create_lru_policy },
+    { "tinylfu", create_tinylfu_policy },
+    { "aging", create_aging_policy },
+    { "lirs", create_lirs_policy },
+    { "clockpro", create_clockpro_policy },
+    { "lfu", create_lfu_policy },
+    { "lfuda", create_lfuda_policy },
+    { NULL, NULL }
+};
+int generate_trace(int argc, char* argv[]);
+int parse_trace_model(const char* name, TraceModel* model);
+int parse_count(const char* text, uint64_t* count);
+TraceGenerator* create_trace_generator(TraceModel model, uint64_t page_count);
+void prepare_trace_generator(TraceGenerator* generator, Random* random);
+uint64_t next_trace_page(TraceGenerator* generator, Random* random);
+void seed_random(Random* random, uint64_t seed);
+uint64_t next_random(Random* random);
+uint64_t next_random_below(Random* random, uint64_t bound);
+double next_random_double(Random* random);
+
+/**
+ * ENTRY POINT: The main entry point of the program
+ * */
+int main(int argc, char* argv[]) {
+
+    /// Hand over to the trace or backing store generators if they were requested.
+    if (argc >= 2 && strcmp(argv[1], "generate") == 0) {
+        return generate_trace(argc - 1, argv + 1);
+    }
+    if (argc >= 2 && strcmp(argv[1], "mkstore") == 0) {
+        return make_backing_store(argc - 1, argv + 1);
+    }
+
+    /// Hand over to the microbenchmarks if they were requested.
+    if (argc >= 2 && strcmp(argv[1], "bench") == 0) {
+        return run_benchmarks(argc - 1, argv + 1);
+    }
+    if (argc >= 2 && strcmp(argv[1], "throughput") == 0) {
+        return run_throughput(argc - 1, argv + 1);
+    }
+
+    /// Hand over to the live statistics viewer if it was requested.
+    if (argc >= 2 && strcmp(argv[1], "watch") == 0) {
+        return watch_live_statistics(argc - 1, argv + 1);
+    }
+
+    /// Show error message if the arguments are incorrect.
+    Options options;
+    if (!parse_options(argc, argv, &options)) {
+        printf("Usage: %s [--backing-store file] [--mmap] [--address-bits N] [--frames N] [--policy name]\n", argv[0]);
+        printf("          [--timings] [--perf-counters] [--latency-histograms] [--histogram-out file]\n");
+        printf("          [--trace-events file] [--trace-events-size N] [--live-stats name]\n");
+        printf("          [--heatmap file] [--heatmap-window N] [--heatmap-format csv|binary]\n");
+        printf("          [--hot-pages K] [--hot-pages-counters N]\n");
+        printf("          [--prefetch stride|markov] [--prefetch-degree N] [--prefetch-table N]\n");
+        printf("          [--page-cache N] [--fault-around N]\n");
+        printf("          [--slow-frames N] [--fast-latency ns] [--slow-latency ns] [--migration-cost ns]\n");
+        printf("          [--promote-threshold N] [--tier-sample N]\n");
+        printf("          [--numa-nodes N] [--cpus N] [--cpu-quantum N] [--numa-policy local|interleave|preferred]\n");
+        printf("          [--numa-preferred node] [--numa-balancing N] [--local-latency ns] [--remote-latency ns]\n");
+        printf("          [--cache] [--cache-l1 size:ways:line] [--cache-l2 size:ways:line] [--cache-llc size:ways:line]\n");
+        printf("          [--page-coloring] [--page-colors N]\n");
+        printf("          [--virtualization nested|shadow] [--guest-pages N] [--guest-policy name] [--nested-tlb N]\n");
+        printf("          [--walk-cache N] [--region code|heap|stack|guard:start:end[:rwx]]... addresses.txt\n");
+        printf("       %s generate [options] trace-file\n", argv[0]);
+        printf("       %s mkstore [options] store-file\n", argv[0]);
+        printf("       %s bench [options]\n", argv[0]);
+        printf("       %s throughput [options]\n", argv[0]);
+        printf("       %s watch [--interval ms] [--timeout ms] name\n", argv[0]);
+        exit(0);
+    }
+
+    /// Run the virtual memory manager over the input addresses.
+    exit(run_simulation(&options, NULL));
 }
 
 /**
- * FUNCTION: create_page_table()
- * Creates and initializes an empty page table with no page number
- * to frame number mappings. All the values are set to -1 to indicate
- * that there is no mapping.
-*/
-PageTable* create_page_table() {
-    PageTable* new_page_table = (PageTable*)malloc(sizeof(PageTable));
-    new_page_table->map = malloc(sizeof(int) * PAGE_TABLE_SIZE);
-    new_page_table->fault_count = 0;
-    for (int i = 0; i < PAGE_TABLE_SIZE; i++) {
-        new_page_table->map[i] = UNMAPPED; /* UNMAPPED == -1 */
+ * FUNCTION run_simulation()
+ * Runs the virtual memory manager as configured by options: translates
+ * every address of the input trace, reading it in batches so that the
+ * trace can be far larger than memory, and writes the translations and
+ * statistics to the output file. Fills in result (if not NULL) with the
+ * totals. Returns 0, or a negative error code if the run could not start.
+ * */
+int run_simulation(Options* options, SimulationResult* result) {
+
+    if (options->timings || options->perf_counters || options->latency_histograms || options->trace_events_path != NULL) {
+        start_timestamp_calibration();
     }
-    return new_page_table;
-}
\ No newline at end of file
+    if (options->timings || options->perf_counters) {
+        start_phase_timers();
+    }
+    if (options->perf_counters && !open_perf_counters()) {
+        fprintf(stderr, "Warning: hardware performance counters are not available, reporting timings only\n");
+    }
+    if (options->latency_histograms) {
+        start_latency_histograms();
+    }
+    if (options->trace_events_path != NULL) {
+        start_event_recording(options->trace_events_capacity);
+    }
+    if (options->hot_pages > 0 && !start_hot_pages(options->hot_pages, options->hot_pages_counters)) {
+        printf("Error: unable to allocate the hot page counters\n");
+        return -4;
+    }
+
+    /// Open the input file, the output file, and the backing store.
+    PhaseMark open_timer = PHASE_BEGIN();
+    FILE* file_input = fopen(options->input_path, "r");
+    FILE* file_output = fopen(options->output_path, "w");
+    BackingStore* backing_store = create_backing_store(options->backing_store_path, options->use_mmap);
+    PHASE_END(PHASE_OPEN, open_timer);
+
+    /// Generate error checking message depending on the file open state.
+    if (file_input == NULL) {
+        printf("Error: unable to open %s\n", options->input_path);
+        return -1;
+    }
+
+    if (file_output == NULL) {
+        printf("Error: unable to open %s\n", options->output_path);
+        return -2;
+    }
+
+    if (backing_store == NULL) {
+        printf("Error: unable to open the backing store '%s'\n", options->backing_store_path);
+        return -3;
+    }
+
+    /// Create a virtual memory struct for the input addresses.
+    PhaseMark setup_timer = PHASE_BEGIN();
+    VirtualMemory* virtual_memory = open_virtual_memory(file_input);
+
+    /// Create an empty physical memory space with no pages in it.
+    PhysicalMemory* physical_memory = create_physical_memory(options->frame_count);
+
+    /// Create a page table with unmapped frames. Under virtualization it is the host's,
+    /// indexed by guest-physical page, behind the guest's own page table.
+    uint64_t page_count = (uint64_t)1 << (options->address_bits - PAGE_NUMBER_OFFSET_BITS);
+    PageTable* page_table = create_page_table(options->virtualization != VIRTUALIZATION_NONE ? (uint64_t)options->guest_page_count : page_count);
+
+    if (physical_memory == NULL || page_table == NULL) {
+        printf("Error: unable to allocate the simulated memory\n");
+        return -4;
+    }
+
+    /// Put a guest in front of the page table if the trace runs in a virtual machine.
+    if (options->virtualization != VIRTUALIZATION_NONE) {
+        page_table->guest = create_virtual_machine(options, page_count);
+        if (page_table->guest == NULL) {
+            printf("Error: unable to create the guest with policy '%s'\n", options->guest_policy_name);
+            return -4;
+        }
+        page_table->backing_pages = (uint64_t*)malloc(sizeof(uint64_t) * page_table->page_count);
+        for (uint64_t guest_page = 0; guest_page < page_table->page_count; guest_page++) {
+            page_table->backing_pages[guest_page] = guest_page;
+        }
+    }
+
+    /// Protect the virtual pages by region if a region map was given.
+    if (options->region_count > 0) {
+        page_table->protections = create_protections(page_count, options->regions, options->region_count);
+        if (page_table->protections == NULL) {
+            printf("Error: unable to allocate the page protections\n");
+            return -4;
+        }
+    }
+
+    /// Cache the upper levels of the walked page table (the guest's or the shadow
+    /// table in a virtual machine) if asked to.
+    if (options->walk_cache_entries > 0) {
+        page_table->walk_cache = create_page_walk_cache(page_table_levels(page_count), options->walk_cache_entries);
+    }
+
+    /// Choose the replacement policy for when physical memory is full. Page coloring
+    /// brings its own, since the victim has to come from the faulting page's color.
+    if (options->page_coloring) {
+        physical_memory->coloring = create_page_coloring(options->frame_count, options->page_colors);
+        physical_memory->policy = create_colored_policy(physical_memory->coloring);
+    } else {
+        physical_memory->policy = create_replacement_policy(options->policy_name, options->frame_count);
+    }
+    if (physical_memory->policy == NULL) {
+        printf("Error: unknown replacement policy '%s'\n", options->policy_name);
+        return -5;
+    }
+
+    /// Load pages ahead of use if a prefetcher was chosen.
+    if (options->prefetcher_name != NULL) {
+        physical_memory->prefetcher = create_prefetcher(options->prefetcher_name, options->frame_count, page_table->page_count,
+                                                        options->prefetch_degree, options->prefetch_table);
+        if (physical_memory->prefetcher == NULL) {
+            printf("Error: unknown prefetcher '%s'\n", options->prefetcher_name);
+            return -8;
+        }
+    }
+
+    /// Keep evicted pages in memory, and map cached neighbours on faults, if asked to.
+    if (options->page_cache_pages > 0) {
+        physical_memory->page_cache = create_page_cache(options->page_cache_pages);
+        if (physical_memory->page_cache == NULL) {
+            printf("Error: unable to allocate the page cache\n");
+            return -4;
+        }
+    }
+    if (options->fault_around_pages > 0) {
+        physical_memory->fault_around_pages = options->fault_around_pages;
+        physical_memory->frame_faulted_around = (unsigned char*)calloc(options->frame_count, sizeof(unsigned char));
+    }
+
+    /// Split memory into a fast and a slow tier if asked to.
+    if (options->slow_frame_count > 0) {
+        physical_memory->tiers = create_memory_tiers(options->frame_count, options);
+    }
+
+    /// Spread the frames over NUMA nodes if asked to.
+    if (options->numa_node_count > 0) {
+        physical_memory->numa = create_numa_memory(options->frame_count, options);
+    }
+
+    /// Run the physical addresses through the CPU caches if asked to.
+    if (options->caches) {
+        physical_memory->caches = create_cache_hierarchy(options);
+        if (physical_memory->caches == NULL) {
+            printf("Error: unable to allocate the cache model\n");
+            return -4;
+        }
+    }
+
+    /// Keep per-page heatmap counters if asked to.
+    if (options->heatmap_path != NULL) {
+        page_table->heatmap = create_heatmap(page_table->page_count, options->heatmap_window, options->heatmap_path, options->heatmap_binary);
+        if (page_table->heatmap == NULL) {
+            printf("Error: unable to create the heatmap '%s'\n", options->heatmap_path);
+            return -7;
+        }
+    }
+    PHASE_END(PHASE_SETUP, setup_timer);
+
+    /// Publish running counters for "vmm watch" if asked to.
+    LiveStatistics* live_statistics = NULL;
+    if (options->live_statistics_name != NULL) {
+        live_statistics = create_live_statistics(options->live_statistics_name, page_table->guest != NULL ? page_table->guest->tlb_entries : 0);
+        if (live_statistics == NULL) {
+            printf("Error: unable to create the live statistics segment '%s'\n", options->live_statistics_name);
+            return -6;
+        }
+    }
+
+    /// Implement the demand paging algorithm, translating each virtual address
+    /// to a physical address and then bring in missing pages from the backing store
+    /// then output the result to the output file, one batch of input at a time
+    for (;;) {
+        PhaseMark parse_timer = PHASE_BEGIN();
+        int address_count = read_virtual_memory(virtual_memory, file_input, TRACE_BATCH_SIZE);
+        PHASE_END(PHASE_PARSE, parse_timer);
+        if (address_count == 0) {
+            break;
+        }
+
+        PhaseMark translate_timer = PHASE_BEGIN();
+        map_addresses(virtual_memory, physical_memory, page_table, backing_store);
+        PHASE_END(PHASE_TRANSLATE, translate_timer);
+
+        PhaseMark output_timer = PHASE_BEGIN();
+        write_translations(virtual_memory, file_output);
+        PHASE_END(PHASE_OUTPUT, output_timer);
+
+        if (live_statistics != NULL) {
+            publish_live_statistics(live_statistics, physical_memory, page_table, 0);
+        }
+    }
+    report_statistics(physical_memory, page_table, file_output);
+    if (page_table->heatmap != NULL && !close_heatmap(page_table->heatmap)) {
+        printf("Error: unable to write the heatmap '%s'\n", options->heatmap_path);
+    }
+
+    if (result != NULL) {
+        result->address_count = physical_memory->address_count;
+        result->fault_count = page_table->fault_count;
+    }
+
+    /// Close all the file descriptors, flushing the rest of the output
+    fclose(file_input);
+    PhaseMark flush_timer = PHASE_BEGIN();
+    fclose(file_output);
+    PHASE_END(PHASE_OUTPUT, flush_timer);
+    close_backing_store(backing_store);
+    printf("Successfully generated output file '%s'\n", options->output_path);
+
+    if (physical_memory->policy->report != NULL) {
+        physical_memory->policy->report(physical_memory->policy->state, stderr);
+    }
+    if (physical_memory->prefetcher != NULL) {
+        report_prefetcher(physical_memory->prefetcher, page_table->fault_count, stderr);
+    }
+    if (physical_memory->page_cache != NULL) {
+        report_page_cache(physical_memory, page_table, stderr);
+    }
+    if (physical_memory->tiers != NULL) {
+        report_memory_tiers(physical_memory->tiers, stderr);
+    }
+    if (physical_memory->numa != NULL) {
+        report_numa_memory(physical_memory->numa, stderr);
+    }
+    if (physical_memory->caches != NULL) {
+        report_caches(physical_memory->caches, stderr);
+    }
+    if (physical_memory->coloring != NULL) {
+        report_page_coloring(physical_memory, stderr);
+    }
+    if (page_table->guest != NULL) {
+        report_virtual_machine(page_table, stderr);
+    }
+    if (page_table->protections != NULL || page_table->protection_faults[PROTECTION_UNMAPPED] > 0) {
+        report_protection_faults(page_table, stderr);
+    }
+    if (page_table->walk_cache != NULL) {
+        int level_references = 1;
+        if (page_table->guest != NULL && page_table->guest->mode == VIRTUALIZATION_NESTED) {
+            level_references = page_table->guest->host_levels + 1;
+        }
+        report_page_walk_cache(page_table->walk_cache, level_references, stderr);
+    }
+    if (options->timings || options->perf_counters) {
+        report_phase_timers(physical_memory->address_count);
+    }
+    close_perf_counters();
+    if (options->latency_histograms) {
+        report_latency_histograms(options->histogram_path);
+    }
+    if (options->hot_pages > 0) {
+        report_hot_pages();
+    }
+    if (live_statistics != NULL) {
+        publish_live_statistics(live_statistics, physical_memory, page_table, 1);
+        munmap(live_statistics, sizeof(LiveStatistics));
+        shm_unlink(options->live_statistics_name);
+    }
+    if (options->trace_events_path != NULL && !write_trace_events(options->trace_events_path)) {
+        printf("Error: unable to write %s\n", options->trace_events_path);
+    }
+    phase_timers.enabled = 0;
+    return 0;
+}
+
+/**
+ * FUNCTION start_phase_timers()
+ * Clears and switches on the phase timers.
+ * */
+void start_phase_timers() {
+    memset(&phase_timers, 0, sizeof(phase_timers));
+    phase_timers.perf_fd = -1;
+    phase_timers.enabled = 1;
+}
+
+/**
+ * FUNCTION report_phase_timers()
+ * Switches off the phase timers and prints the time spent in each phase
+ * to stderr. Fault service is timed inside the translation loop, so
+ * translation is reported without it; output is timed once per batch
+ * after the batch is translated. If hardware counters were open, their
+ * totals are printed per phase and, over translation and output
+ * together, per translated address.
+ * */
+void report_phase_timers(uint64_t address_count) {
+    double total_nanoseconds = 0.0;
+    double tick_nanoseconds = nanoseconds_per_tick(&total_nanoseconds);
+    phase_timers.enabled = 0;
+
+    uint64_t translation_counters[PERF_COUNTER_COUNT];
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        translation_counters[i] = phase_timers.counters[PHASE_TRANSLATE][i] + phase_timers.counters[PHASE_OUTPUT][i];
+    }
+
+    uint64_t nested = phase_timers.ticks[PHASE_FAULT];
+    phase_timers.ticks[PHASE_TRANSLATE] = phase_timers.ticks[PHASE_TRANSLATE] > nested ? phase_timers.ticks[PHASE_TRANSLATE] - nested : 0;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        nested = phase_timers.counters[PHASE_FAULT][i];
+        phase_timers.counters[PHASE_TRANSLATE][i] = phase_timers.counters[PHASE_TRANSLATE][i] > nested ? phase_timers.counters[PHASE_TRANSLATE][i] - nested : 0;
+    }
+
+    fprintf(stderr, "Phase timings (%.3f ms total):\n", total_nanoseconds / 1e6);
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        double nanoseconds = (double)phase_timers.ticks[i] * tick_nanoseconds;
+        fprintf(stderr, "  %-18s %12.3f ms %6.1f%% %12" PRIu64 " intervals\n", phase_names[i], nanoseconds / 1e6,
+                total_nanoseconds > 0.0 ? 100.0 * nanoseconds / total_nanoseconds : 0.0, phase_timers.counts[i]);
+    }
+
+    if (phase_timers.perf_fd < 0) {
+        return;
+    }
+
+    static const char* counter_names[PERF_COUNTER_COUNT] = { "cycles", "instructions", "LLC misses", "dTLB misses", "branch misses" };
+    fprintf(stderr, "Hardware counters:\n  %-18s", "");
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        fprintf(stderr, " %15s", counter_names[i]);
+    }
+    fprintf(stderr, "\n");
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        fprintf(stderr, "  %-18s", phase_names[phase]);
+        for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+            fprintf(stderr, " %15" PRIu64, phase_timers.counters[phase][i]);
+        }
+        fprintf(stderr, "\n");
+    }
+    fprintf(stderr, "  %-18s", "per address");
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        fprintf(stderr, " %15.3f", address_count > 0 ? (double)translation_counters[i] / (double)address_count : 0.0);
+    }
+    fprintf(stderr, "\n");
+    if (translation_counters[PERF_CYCLES] > 0) {
+        fprintf(stderr, "  instructions per cycle (translation loop): %.3f\n",
+                (double)translation_counters[PERF_INSTRUCTIONS] / (double)translation_counters[PERF_CYCLES]);
+    }
+}
+
+/**
+ * FUNCTION start_latency_histograms()
+ * Clears and switches on the latency histograms.
+ * */
+void start_latency_histograms() {
+    memset(&latency_histograms, 0, sizeof(latency_histograms));
+    latency_histograms.fault.name = "fault service";
+    latency_histograms.translation.name = "translation";
+    latency_histograms.enabled = 1;
+}
+
+/**
+ * FUNCTION report_latency_histograms()
+ * Switches off the latency histograms and prints their percentiles in
+ * nanoseconds to stderr. If export_path is set, every non-empty bucket
+ * is also written there as CSV (histogram, low and high bound in
+ * nanoseconds, count).
+ * */
+void report_latency_histograms(const char* export_path) {
+    double tick_nanoseconds = nanoseconds_per_tick(NULL);
+    latency_histograms.enabled = 0;
+
+    LatencyHistogram* histograms[2] = { &latency_histograms.fault, &latency_histograms.translation };
+    static const double percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+
+    fprintf(stderr, "Latency (ns):        %12s %10s %10s %10s %10s %12s\n", "count", "p50", "p90", "p99", "p99.9", "max");
+    for (int h = 0; h < 2; h++) {
+        fprintf(stderr, "  %-18s %12" PRIu64, histograms[h]->name, histograms[h]->total_count);
+        for (int p = 0; p < 4; p++) {
+            fprintf(stderr, " %10.0f", (double)histogram_percentile(histograms[h], percentiles[p]) * tick_nanoseconds);
+        }
+        fprintf(stderr, " %12.0f\n", (double)histograms[h]->max_value * tick_nanoseconds);
+    }
+
+    if (export_path == NULL) {
+        return;
+    }
+    FILE* export_file = fopen(export_path, "w");
+    if (export_file == NULL) {
+        fprintf(stderr, "Error: unable to open %s\n", export_path);
+        return;
+    }
+    fprintf(export_file, "histogram,low_ns,high_ns,count\n");
+    for (int h = 0; h < 2; h++) {
+        for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            if (histograms[h]->counts[i] > 0) {
+                fprintf(export_file, "%s,%.1f,%.1f,%" PRIu64 "\n", histograms[h]->name,
+                        (double)histogram_bucket_low(i) * tick_nanoseconds,
+                        (double)histogram_bucket_low(i + 1) * tick_nanoseconds, histograms[h]->counts[i]);
+            }
+        }
+    }
+    fclose(export_file);
+}
+
+/**
+ * FUNCTION histogram_bucket_low()
+ * Returns the smallest value that falls into a histogram bucket.
+ * */
+uint64_t histogram_bucket_low(int index) {
+    int half = 1 << (HISTOGRAM_SUB_BUCKET_BITS - 1);
+    if (index < 2 * half) {
+        return (uint64_t)index;
+    }
+    int shift = index / half - 1;
+    return (uint64_t)(index - shift * half) << shift;
+}
+
+/**
+ * FUNCTION histogram_percentile()
+ * Returns the value at the given percentile, as the upper bound of the
+ * bucket it falls in, capped at the largest value recorded.
+ * */
+uint64_t histogram_percentile(LatencyHistogram* histogram, double percentile) {
+    uint64_t target = (uint64_t)ceil(percentile / 100.0 * (double)histogram->total_count);
+    uint64_t seen = 0;
+    if (target == 0) {
+        return 0;
+    }
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= target) {
+            uint64_t high = histogram_bucket_low(i + 1) - 1;
+            return high < histogram->max_value ? high : histogram->max_value;
+        }
+    }
+    return histogram->max_value;
+}
+
+/**
+ * FUNCTION start_event_recording()
+ * Switches on the event recorder with rings of capacity events (rounded
+ * up to a power of two) per thread. Phase boundaries are recorded through
+ * the phase hooks, so those are switched on as well.
+ * */
+void start_event_recording(uint64_t capacity) {
+    uint64_t rounded = 1;
+    while (rounded < capacity) {
+        rounded <<= 1;
+    }
+    event_recorder.capacity = rounded;
+    event_recorder.enabled = 1;
+    phase_timers.enabled = 1;
+}
+
+/**
+ * FUNCTION record_event()
+ * Appends an event to the calling thread's ring, creating and registering
+ * the ring on the thread's first event. Registration pushes the ring onto
+ * the recorder's list with a compare-and-swap, so it takes no lock either.
+ * */
+void record_event(EventType type, uint64_t ticks, uint64_t duration, uint64_t page_number, int argument) {
+    EventRing* ring = thread_event_ring;
+    if (ring == NULL) {
+        ring = (EventRing*)calloc(1, sizeof(EventRing));
+        ring->capacity = event_recorder.capacity;
+        ring->events = (Event*)malloc(sizeof(Event) * ring->capacity);
+        ring->thread_id = atomic_fetch_add(&event_recorder.next_thread_id, 1) + 1;
+        ring->next = atomic_load(&event_recorder.rings);
+        while (!atomic_compare_exchange_weak(&event_recorder.rings, &ring->next, ring)) {
+        }
+        thread_event_ring = ring;
+    }
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == ring->capacity) {
+        ring->dropped++;
+        return;
+    }
+    Event* event = &ring->events[head & (ring->capacity - 1)];
+    event->ticks = ticks;
+    event->duration = duration;
+    event->page_number = page_number;
+    event->argument = argument;
+    event->type = type;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+/**
+ * FUNCTION write_trace_events()
+ * Switches off the event recorder and drains every ring into a Chrome
+ * trace-event JSON file, which chrome://tracing and Perfetto both open.
+ * Phases and faults are complete ("X") events and evictions are instant
+ * ("i") events, one track per recording thread. Returns 0 if the file
+ * could not be written.
+ * */
+int write_trace_events(const char* path) {
+    double microseconds_per_tick = nanoseconds_per_tick(NULL) / 1e3;
+    event_recorder.enabled = 0;
+
+    FILE* trace_file = fopen(path, "w");
+    if (trace_file == NULL) {
+        return 0;
+    }
+
+    uint64_t dropped = 0;
+    fprintf(trace_file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    fprintf(trace_file, "  {\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"vmm\"}}");
+    for (EventRing* ring = atomic_load(&event_recorder.rings); ring != NULL; ring = ring->next) {
+        fprintf(trace_file, ",\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"simulator %d\"}}",
+                ring->thread_id, ring->thread_id);
+
+        uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        for (; tail != head; tail++) {
+            Event* event = &ring->events[tail & (ring->capacity - 1)];
+            double timestamp = (double)(event->ticks - timestamp_calibration.start_ticks) * microseconds_per_tick;
+            double duration = (double)event->duration * microseconds_per_tick;
+            if (event->type == EVENT_PHASE) {
+                fprintf(trace_file, ",\n  {\"name\": \"%s\", \"cat\": \"phase\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                        phase_names[event->argument], ring->thread_id, timestamp, duration);
+            } else if (event->type == EVENT_FAULT) {
+                fprintf(trace_file, ",\n  {\"name\": \"fault\", \"cat\": \"paging\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, "
+                        "\"args\": {\"page\": %" PRIu64 ", \"frame\": %d}}", ring->thread_id, timestamp, duration, event->page_number, event->argument);
+            } else {
+                fprintf(trace_file, ",\n  {\"name\": \"evict\", \"cat\": \"paging\", \"ph\": \"i\", \"s\": \"t\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, "
+                        "\"args\": {\"page\": %" PRIu64 ", \"frame\": %d}}", ring->thread_id, timestamp, event->page_number, event->argument);
+            }
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        dropped += ring->dropped;
+    }
+    fprintf(trace_file, "\n], \"otherData\": {\"dropped_events\": %" PRIu64 "}}\n", dropped);
+
+    if (dropped > 0) {
+        fprintf(stderr, "Warning: %" PRIu64 " events did not fit in the event ring (see --trace-events-size)\n", dropped);
+    }
+    return fclose(trace_file) == 0;
+}
+
+/**
+ * FUNCTION open_perf_counters()
+ * Opens the hardware counters as one perf event group for this process,
+ * counting user-space events only. Events the CPU (or a virtual machine)
+ * does not support are left at zero. Returns 0 if no counter could be
+ * opened at all.
+ * */
+int open_perf_counters() {
+#ifdef __linux__
+    static const uint32_t types[PERF_COUNTER_COUNT] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE
+    };
+    static const uint64_t configs[PERF_COUNTER_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+
+    phase_timers.perf_slot_count = 0;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        struct perf_event_attr attributes;
+        memset(&attributes, 0, sizeof(attributes));
+        attributes.size = sizeof(attributes);
+        attributes.type = types[i];
+        attributes.config = configs[i];
+        attributes.disabled = phase_timers.perf_fd < 0;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        attributes.read_format = PERF_FORMAT_GROUP;
+
+        int fd = (int)syscall(SYS_perf_event_open, &attributes, 0, -1, phase_timers.perf_fd, 0);
+        if (fd < 0) {
+            continue;
+        }
+        if (phase_timers.perf_fd < 0) {
+            phase_timers.perf_fd = fd;
+        }
+        phase_timers.perf_slots[phase_timers.perf_slot_count++] = (PerfCounter)i;
+    }
+
+    if (phase_timers.perf_fd < 0) {
+        return 0;
+    }
+    ioctl(phase_timers.perf_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(phase_timers.perf_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * FUNCTION read_perf_counters()
+ * Reads the current value of every hardware counter with one read() of
+ * the event group. Counters that could not be opened read as zero.
+ * */
+void read_perf_counters(uint64_t* counters) {
+    uint64_t values[1 + PERF_COUNTER_COUNT];
+    memset(counters, 0, sizeof(uint64_t) * PERF_COUNTER_COUNT);
+    if (read(phase_timers.perf_fd, values, sizeof(values)) < (ssize_t)sizeof(uint64_t)) {
+        return;
+    }
+    for (uint64_t i = 0; i < values[0] && i < (uint64_t)phase_timers.perf_slot_count; i++) {
+        counters[phase_timers.perf_slots[i]] = values[1 + i];
+    }
+}
+
+/**
+ * FUNCTION close_perf_counters()
+ * Closes the hardware counter group, if it is open.
+ * */
+void close_perf_counters() {
+    if (phase_timers.perf_fd >= 0) {
+        close(phase_timers.perf_fd);
+        phase_timers.perf_fd = -1;
+    }
+}
+
+/**
+ * FUNCTION map_addresses()
+ * Translates virtual addresses from a VirtualAddress struct into
+ * physical addresses using demand paging. The result is kept in each
+ * VirtualAddress for write_translations() to output.
+ * */
+void map_addresses(VirtualMemory* virtual_memory, PhysicalMemory* physical_memory, PageTable* page_table, BackingStore* backing_store) {
+    uint64_t fault_count = page_table->fault_count;
+    uint64_t virtual_page_count = page_table->guest != NULL ? page_table->guest->guest_table->page_count : page_table->page_count;
+    const unsigned char* protections = page_table->protections;
+
+    /// For each virtual address
+    for (int i = 0; i < virtual_memory->address_count; i++) {
+
+        /// Track the virtual address's attributes
+        int va_page_offset = virtual_memory->addresses[i].page_offset;
+        uint64_t va_page_number = virtual_memory->addresses[i].page_number;
+
+        /// Refuse the access if the page is outside the address space or its protection
+        /// does not allow it: one comparison and one table lookup per address.
+        int va_access = virtual_memory->addresses[i].access;
+        if (__builtin_expect(va_page_number >= virtual_page_count ||
+                             (protections != NULL && (protections[va_page_number] & va_access) != va_access), 0)) {
+            record_protection_fault(page_table, &virtual_memory->addresses[i]);
+            continue;
+        }
+
+        /// Note when the translation starts if its latency is being recorded
+        uint64_t translation_start = __builtin_expect(latency_histograms.enabled, 0) ? read_timestamp() : 0;
+
+        /// In a virtual machine the guest translates the page first, and everything
+        /// below sees the guest-physical page it maps to.
+        uint64_t page_number = va_page_number;
+        if (__builtin_expect(page_table->guest != NULL, 0)) {
+            page_number = translate_guest_page(physical_memory, page_table, backing_store, va_page_number);
+        } else if (__builtin_expect(page_table->walk_cache != NULL, 0)) {
+            walk_page_table(page_table->walk_cache, page_number);
+        }
+
+        /// Translate the Virtual Address into a Physical Address
+        /// The frame number is obtained from the page table[page number]
+        /// The frame offset is obtained form the page offset
+        int pa_frame_number = page_table->map[page_number];
+        int pa_frame_offset = va_page_offset;
+
+        /// Count the access in the heatmap if one is kept.
+        if (__builtin_expect(page_table->heatmap != NULL, 0)) {
+            record_page_access(page_table->heatmap, page_number, pa_frame_number == UNMAPPED);
+        }
+        if (__builtin_expect(hot_pages.enabled, 0)) {
+            record_hot_page(page_number);
+        }
+
+        /// If there is no frame number in the page table index selected,
+        /// demand the page from the backing store. Otherwise let the
+        /// replacement policy know the frame was used.
+        if (pa_frame_number == UNMAPPED) {
+            PhaseMark fault_timer = PHASE_BEGIN();
+            uint64_t fault_start = __builtin_expect(latency_histograms.enabled | event_recorder.enabled, 0) ? read_timestamp() : 0;
+            pa_frame_number = service_page_fault(physical_memory, page_table, backing_store, page_number);
+            if (__builtin_expect(latency_histograms.enabled | event_recorder.enabled, 0)) {
+                uint64_t fault_ticks = read_timestamp() - fault_start;
+                if (latency_histograms.enabled) {
+                    record_latency(&latency_histograms.fault, fault_ticks);
+                }
+                if (event_recorder.enabled) {
+                    record_event(EVENT_FAULT, fault_start, fault_ticks, page_number, pa_frame_number);
+                }
+            }
+            PHASE_END(PHASE_FAULT, fault_timer);
+        } else if (physical_memory->policy->access != NULL) {
+            physical_memory->policy->access(physical_memory->policy->state, pa_frame_number, page_number);
+        }
+        if (__builtin_expect(page_table->guest != NULL, 0) && page_table->guest->tlb_missed) {
+            complete_guest_translation(page_table->guest, va_page_number, page_number, pa_frame_number);
+        }
+
+        /// Note whether this access missed, counting the first use of a prefetched page as a miss avoided.
+        int missed = page_table->fault_count != fault_count;
+        fault_count = page_table->fault_count;
+        if (__builtin_expect(physical_memory->prefetcher != NULL, 0) && physical_memory->prefetcher->frame_prefetched[pa_frame_number]) {
+            physical_memory->prefetcher->frame_prefetched[pa_frame_number] = 0;
+            physical_memory->prefetcher->useful++;
+            missed = 1;
+        }
+        if (__builtin_expect(physical_memory->frame_faulted_around != NULL, 0) && physical_memory->frame_faulted_around[pa_frame_number]) {
+            physical_memory->frame_faulted_around[pa_frame_number] = 0;
+            page_table->fault_around_hits++;
+        }
+        if (__builtin_expect(physical_memory->tiers != NULL, 0)) {
+            record_tier_access(physical_memory->tiers, pa_frame_number);
+        }
+        if (__builtin_expect(physical_memory->numa != NULL, 0)) {
+            record_numa_access(physical_memory->numa, pa_frame_number);
+        }
+
+        /// For convenience, all of the information we retrieve is stored in a Physical Address struct
+        /// and stored in a PhysicalMemory struct for later access.
+
+        /// Fill in the physical address entry of the frame
+        PhysicalAddress* physical_address = &physical_memory->addresses[pa_frame_number];
+
+        /// Add the frame number and the offset we got earlier
+        physical_address->frame_number = pa_frame_number;
+        physical_address->frame_offset = pa_frame_offset;
+
+        /// Generate the address by combining the frame number and the frame offset using bit shift and bitwise OR
+        physical_address->address = ((uint64_t)physical_address->frame_number << FRAME_NUMBER_OFFSET_BITS) | (uint64_t)physical_address->frame_offset;
+
+        /// Obtain the value of associated address from the space using the frame number, offset, and page size,
+        /// since it is guaranteed to have a page there now from demanding it earlier if it is missing
+        physical_address->value = physical_memory->space[pa_frame_offset + ((size_t)pa_frame_number * PAGE_SIZE)];
+        if (__builtin_expect(physical_memory->caches != NULL, 0)) {
+            access_caches(physical_memory->caches, physical_address->address);
+        }
+
+        if (__builtin_expect(latency_histograms.enabled, 0)) {
+            record_latency(&latency_histograms.translation, read_timestamp() - translation_start);
+        }
+
+        /// Increase the address count within the physical memory (for debug and error checking).
+        physical_memory->address_count++;
+
+        /// Keep the translation, mapping, and associated value for the output file
+        virtual_memory->addresses[i].physical_address = physical_address->address;
+        virtual_memory->addresses[i].value = physical_address->value;
+        virtual_memory->addresses[i].protection_fault = NO_PROTECTION_FAULT;
+
+        /// Load the pages the prefetcher expects next, once this translation is done with its frame.
+        if (__builtin_expect(physical_memory->prefetcher != NULL, 0)) {
+            prefetch_pages(physical_memory, page_table, backing_store, page_number, missed);
+        }
+    }
+}
+
+/**
+ * FUNCTION write_translations()
+ * Writes the translation of every address of the batch to the output
+ * file in trace order, or the protection fault written in its place.
+ * */
+void write_translations(VirtualMemory* virtual_memory, FILE* output_file) {
+    static const char* fault_names[PROTECTION_FAULT_KINDS] = {
+        "unmapped page", "guard page", "read not allowed", "write not allowed", "execute not allowed"
+    };
+    for (int i = 0; i < virtual_memory->address_count; i++) {
+        VirtualAddress* virtual_address = &virtual_memory->addresses[i];
+        if (__builtin_expect(virtual_address->protection_fault != NO_PROTECTION_FAULT, 0)) {
+            fprintf(output_file, "Virtual address: %" PRIu64 " Protection fault: %s\n", virtual_address->address,
+                    fault_names[virtual_address->protection_fault]);
+        } else {
+            fprintf(output_file, TRANSLATION_FORMAT, virtual_address->address, virtual_address->physical_address, virtual_address->value);
+        }
+    }
+}
+
+/**
+ * FUNCTION report_statistics()
+ * Outputs the final statistics over every translated address into the output file.
+ * */
+void report_statistics(PhysicalMemory* physical_memory, PageTable* page_table, FILE* output_file) {
+    fprintf(output_file, "Page Faults = %" PRIu64 "\n", page_table->fault_count);
+    fprintf(output_file, "Page Fault Rate = %.3f\n", (float)page_table->fault_count / (float)physical_memory->address_count);
+}
+
+/**
+ * FUNCTION service_page_fault()
+ * Handles a page fault for page_number using demand paging, loading the
+ * page into a frame. Returns the frame number the page now occupies.
+ * */
+int service_page_fault(PhysicalMemory* physical_memory, PageTable* page_table, BackingStore* backing_store, uint64_t page_number) {
+    /// Add one to the fault counter
+    page_table->fault_count++;
+
+    /// Blame the fault on the prefetcher if a prefetch evicted the page.
+    Prefetcher* prefetcher = physical_memory->prefetcher;
+    if (__builtin_expect(prefetcher != NULL, 0) && (prefetcher->evicted_pages[page_number >> 6] >> (page_number & 63)) & 1) {
+        prefetcher->polluting_faults++;
+    }
+
+    /// Map the cached neighbours first, so that they cannot evict the page being faulted in.
+    if (physical_memory->fault_around_pages > 0) {
+        fault_around(physical_memory, page_table, backing_store, page_number);
+    }
+    return load_page(physical_memory, page_table, backing_store, page_number, LOAD_DEMAND);
+}
+
+/**
+ * FUNCTION fault_around()
+ * Maps the pages in the aligned window of fault_around_pages around
+ * page_number that are unmapped but still in the page cache, so that
+ * touching them later does not take a minor fault. No page is read from
+ * the backing store.
+ * */
+void fault_around(PhysicalMemory* physical_memory, PageTable* page_table, BackingStore* backing_store, uint64_t page_number) {
+    uint64_t first_page = page_number & ~(uint64_t)(physical_memory->fault_around_pages - 1);
+    for (uint64_t neighbour = first_page; neighbour < first_page + (uint64_t)physical_memory->fault_around_pages; neighbour++) {
+        if (neighbour != page_number && neighbour < page_table->page_count && page_table->map[neighbour] == UNMAPPED &&
+            page_is_cached(physical_memory->page_cache, neighbour)) {
+            load_page(physical_memory, page_table, backing_store, neighbour, LOAD_FAULT_AROUND);
+            page_table->fault_around_count++;
+        }
+    }
+}
+
+/**
+ * FUNCTION load_page()
+ * Takes a free frame, or asks the replacement policy for a victim frame
+ * and evicts the page in it (into the page cache, if there is one), then
+ * copies page_number in from the page cache or the backing store and
+ * maps it. Returns the frame number the page occupies.
+ * */
+int load_page(PhysicalMemory* physical_memory, PageTable* page_table, BackingStore* backing_store, uint64_t page_number, LoadReason reason) {
+    /// Get a free frame number from the physical memory while there are any left,
+    /// otherwise reuse the frame the replacement policy picks
+    int frame_number;
+    if (physical_memory->next_available_frame_index < physical_memory->frame_count) {
+        frame_number = physical_memory->next_available_frame_index;
+        physical_memory->next_available_frame_index++;
+        if (__builtin_expect(physical_memory->numa != NULL, 0)) {
+            frame_number = allocate_numa_frame(physical_memory->numa);
+        } else if (__builtin_expect(physical_memory->coloring != NULL, 0)) {
+            frame_number = allocate_colored_frame(physical_memory->coloring, page_number);
+        }
+    } else {
+        if (__builtin_expect(physical_memory->coloring != NULL, 0)) {
+            physical_memory->coloring->wanted_color = (int)(page_number % (uint64_t)physical_memory->coloring->color_count);
+        }
+        frame_number = physical_memory->policy->victim(physical_memory->policy->state);
+    }
+
+    /// If the frame still holds an older page, evict it by removing its mapping
+    if (physical_memory->frame_pages[frame_number] != UNMAPPED) {
+        page_table->map[physical_memory->frame_pages[frame_number]] = UNMAPPED;
+        physical_memory->eviction_count++;
+        if (__builtin_expect(page_table->guest != NULL, 0) && page_table->guest->mode == VIRTUALIZATION_SHADOW) {
+            invalidate_shadow_page(page_table, (uint64_t)physical_memory->frame_pages[frame_number]);
+        }
+        if (__builtin_expect(page_table->heatmap != NULL, 0)) {
+            touch_page_heat(page_table->heatmap, (uint64_t)physical_memory->frame_pages[frame_number])->evictions++;
+        }
+        if (__builtin_expect(event_recorder.enabled, 0)) {
+            record_event(EVENT_EVICTION, read_timestamp(), 0, (uint64_t)physical_memory->frame_pages[frame_number], frame_number);
+        }
+        if (__builtin_expect(physical_memory->prefetcher != NULL, 0)) {
+            Prefetcher* prefetcher = physical_memory->prefetcher;
+            uint64_t evicted_page = (uint64_t)physical_memory->frame_pages[frame_number];
+            prefetcher->unused += prefetcher->frame_prefetched[frame_number];
+            if (reason == LOAD_PREFETCH) {
+                prefetcher->evicted_pages[evicted_page >> 6] |= (uint64_t)1 << (evicted_page & 63);
+            }
+        }
+    }
+    if (__builtin_expect(physical_memory->prefetcher != NULL, 0)) {
+        physical_memory->prefetcher->frame_prefetched[frame_number] = reason == LOAD_PREFETCH;
+        physical_memory->prefetcher->evicted_pages[page_number >> 6] &= ~((uint64_t)1 << (page_number & 63));
+    }
+    if (__builtin_expect(physical_memory->frame_faulted_around != NULL, 0)) {
+        physical_memory->frame_faulted_around[frame_number] = reason == LOAD_FAULT_AROUND;
+    }
+    if (__builtin_expect(physical_memory->tiers != NULL, 0)) {
+        physical_memory->tiers->heat[frame_number] = 0;
+    }
+    if (__builtin_expect(physical_memory->numa != NULL, 0)) {
+        physical_memory->numa->frame_last_nodes[frame_number] = UNMAPPED;
+    }
+    if (__builtin_expect(physical_memory->caches != NULL, 0)) {
+        invalidate_cached_frame(physical_memory->caches, frame_number);
+    }
+
+    /// Copy the page that corresponds to the missing unmapped page number
+    /// into the frame: from the page cache if it is still there (a minor
+    /// fault), otherwise from the backing store.
+    signed char* frame = physical_memory->space + (size_t)frame_number * FRAME_SIZE;
+    if (__builtin_expect(physical_memory->page_cache != NULL, 0)) {
+        if (physical_memory->frame_pages[frame_number] != UNMAPPED) {
+            cache_evicted_page(physical_memory->page_cache, (uint64_t)physical_memory->frame_pages[frame_number], frame);
+        }
+        if (take_cached_page(physical_memory->page_cache, page_number, frame)) {
+            page_table->minor_fault_count += reason == LOAD_DEMAND;
+        } else {
+            read_backing_store_page(backing_store, page_number, frame);
+        }
+    } else if (__builtin_expect(page_table->backing_pages != NULL, 0)) {
+        read_backing_store_page(backing_store, page_table->backing_pages[page_number], frame);
+    } else {
+        read_backing_store_page(backing_store, page_number, frame);
+    }
+
+    /// Add the mapped frame number with actual page contents into the
+    /// page table map so that it can be accessed later on.
+    page_table->map[page_number] = frame_number;
+    physical_memory->frame_pages[frame_number] = (int64_t)page_number;
+    physical_memory->policy->install(physical_memory->policy->state, frame_number, page_number);
+    return frame_number;
+}
+
+/**
+ * FUNCTION create_virtual_memory()
+ * Creates a virtual memory space, with a list of virtual addresses
+ * and their extracted page number and page offsets from an input file
+ * containing a variable amount of virtual addresses.
+*/
+VirtualMemory* create_virtual_memory(FILE* file_input) {
+    VirtualMemory* new_virtual_memory = open_virtual_memory(file_input);
+    read_virtual_memory(new_virtual_memory, file_input, INT32_MAX);
+    return new_virtual_memory;
+}
+
+/**
+ * FUNCTION open_virtual_memory()
+ * Creates an empty virtual memory space for an input file and works out
+ * whether the file is a binary or a text trace. The addresses are then
+ * read, in one go or in batches, with read_virtual_memory().
+*/
+VirtualMemory* open_virtual_memory(FILE* file_input) {
+
+    /// Create a new virtual memory space
+    VirtualMemory* new_virtual_memory = (VirtualMemory*)malloc(sizeof(VirtualMemory));
+    new_virtual_memory->address_count = 0;
+    new_virtual_memory->address_capacity = 0;
+    new_virtual_memory->addresses = NULL;
+
+    /// A binary trace starts with a magic header followed by 64-bit little-endian addresses.
+    /// Otherwise it is a text trace with one decimal address per line.
+    unsigned char header[TRACE_BINARY_MAGIC_SIZE];
+    new_virtual_memory->binary = fread(header, 1, TRACE_BINARY_MAGIC_SIZE, file_input) == TRACE_BINARY_MAGIC_SIZE &&
+                                 memcmp(header, TRACE_BINARY_MAGIC, TRACE_BINARY_MAGIC_SIZE) == 0;
+    if (!new_virtual_memory->binary) {
+        fseek(file_input, 0, SEEK_SET);
+    }
+    return new_virtual_memory;
+}
+
+/**
+ * FUNCTION read_virtual_memory()
+ * Replaces the virtual memory's address list with the next (up to)
+ * max_count addresses from the input file, so that traces far larger
+ * than memory can be translated one batch at a time. Returns the
+ * number of addresses read, which is 0 at the end of the file.
+*/
+int read_virtual_memory(VirtualMemory* virtual_memory, FILE* file_input, int max_count) {
+    virtual_memory->address_count = 0;
+
+    if (virtual_memory->binary) {
+        unsigned char record[8];
+        while (virtual_memory->address_count < max_count && fread(record, 1, sizeof(record), file_input) == sizeof(record)) {
+            uint64_t address = 0;
+            for (int i = 7; i >= 0; i--) {
+                address = (address << 8) | record[i];
+            }
+            VirtualAddress* new_address = append_virtual_address(virtual_memory);
+            new_address->address = address;
+            new_address->page_number = address >> PAGE_NUMBER_OFFSET_BITS;
+            new_address->page_offset = (int)(address & PAGE_OFFSET_MASK);
+            new_address->access = PAGE_VALID | PAGE_READ;
+        }
+        return virtual_memory->address_count;
+    }
+
+    /// Set buffers for reading a line from the input file
+    int   buffer_char;
+    char* buffer_line_chars = malloc(sizeof(char));
+    int   buffer_line_index = 0;
+
+    /// Scan each character until the end of the file, or until the batch is full.
+    while (virtual_memory->address_count < max_count && (buffer_char = getc(file_input)) != EOF) {
+
+        if (buffer_char != '\n') {
+            /// If within a line, store the characters in the line buffer
+            buffer_line_chars = realloc(buffer_line_chars, sizeof(char) * (buffer_line_index + 2));
+            buffer_line_chars[buffer_line_index] = (char)buffer_char;
+            buffer_line_index++;
+            buffer_line_chars[buffer_line_index] = 0;
+
+        } else if (buffer_char == '\n') {
+            /// If at the end of the line, create a new virtual address from the contents
+            /// and add it to the virtual memory's address list
+            VirtualAddress* new_address = append_virtual_address(virtual_memory);
+            /// Convert the characters to integers, followed by an optional access type
+            /// (r, w or x; reads by default)
+            char* access_type = NULL;
+            new_address->address = strtoull(buffer_line_chars, &access_type, 10);
+            while (*access_type == ' ' || *access_type == '\t') {
+                access_type++;
+            }
+            new_address->access = PAGE_VALID | PAGE_READ;
+            if (*access_type == 'w' || *access_type == 'W') {
+                new_address->access = PAGE_VALID | PAGE_WRITE;
+            } else if (*access_type == 'x' || *access_type == 'X') {
+                new_address->access = PAGE_VALID | PAGE_EXECUTE;
+            }
+            /// Get the page number by shifting the bits a set size
+            new_address->page_number = new_address->address >> PAGE_NUMBER_OFFSET_BITS;
+            /// Get the page offset by masking the leftmost bits a set size
+            new_address->page_offset = new_address->address & PAGE_OFFSET_MASK;
+
+            /// Reset the line buffer for the next line.
+            buffer_line_chars[0] = 0;
+            buffer_line_index = 0;
+        }
+    }
+    free(buffer_line_chars);
+
+    /// Return the number of addresses in this batch.
+    return virtual_memory->address_count;
+}
+
+/**
+ * FUNCTION append_virtual_address()
+ * Adds an entry to the end of the virtual memory's address list, growing
+ * the list geometrically, and returns it for the caller to fill in.
+*/
+VirtualAddress* append_virtual_address(VirtualMemory* virtual_memory) {
+    if (virtual_memory->address_count == virtual_memory->address_capacity) {
+        virtual_memory->address_capacity = virtual_memory->address_capacity ? virtual_memory->address_capacity * 2 : 1024;
+        virtual_memory->addresses = realloc(virtual_memory->addresses, sizeof(VirtualAddress) * virtual_memory->address_capacity);
+    }
+    return &virtual_memory->addresses[virtual_memory->address_count++];
+}
+
+/**
+ * FUNCTION: create_physical_memory()
+ * Creates a Physical memory space of frame_count frames.
+ * This memory space's frames is all free (There are no pages in it yet.)
+ * Returns NULL if the space cannot be allocated.
+ * */
+PhysicalMemory* create_physical_memory(int frame_count) {
+    PhysicalMemory* new_physical_memory = (PhysicalMemory*)malloc(sizeof(PhysicalMemory));
+    new_physical_memory->frame_count = frame_count;
+    new_physical_memory->addresses = (PhysicalAddress*)malloc(sizeof(PhysicalAddress) * frame_count);
+    new_physical_memory->space = (signed char*)malloc(sizeof(signed char) * (size_t)frame_count * FRAME_SIZE);
+    new_physical_memory->frame_pages = (int64_t*)malloc(sizeof(int64_t) * frame_count);
+    if (new_physical_memory->addresses == NULL || new_physical_memory->space == NULL || new_physical_memory->frame_pages == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < frame_count; i++) {
+        new_physical_memory->frame_pages[i] = UNMAPPED;
+    }
+    new_physical_memory->next_available_frame_index = 0;
+    new_physical_memory->address_count = 0;
+    new_physical_memory->eviction_count = 0;
+    new_physical_memory->policy = NULL;
+    new_physical_memory->prefetcher = NULL;
+    new_physical_memory->page_cache = NULL;
+    new_physical_memory->fault_around_pages = 0;
+    new_physical_memory->frame_faulted_around = NULL;
+    new_physical_memory->tiers = NULL;
+    new_physical_memory->numa = NULL;
+    new_physical_memory->caches = NULL;
+    new_physical_memory->coloring = NULL;
+    return new_physical_memory;
+}
+
+/**
+ * FUNCTION: create_page_table()
+ * Creates and initializes an empty page table of page_count entries with
+ * no page number to frame number mappings. All the values are set to -1
+ * to indicate that there is no mapping. Returns NULL if the table cannot
+ * be allocated.
+*/
+PageTable* create_page_table(uint64_t page_count) {
+    PageTable* new_page_table = (PageTable*)malloc(sizeof(PageTable));
+    new_page_table->map = malloc(sizeof(int) * page_count);
+    if (new_page_table->map == NULL) {
+        return NULL;
+    }
+    new_page_table->page_count = page_count;
+    new_page_table->fault_count = 0;
+    new_page_table->minor_fault_count = 0;
+    new_page_table->fault_around_count = 0;
+    new_page_table->fault_around_hits = 0;
+    new_page_table->heatmap = NULL;
+    new_page_table->guest = NULL;
+    new_page_table->backing_pages = NULL;
+    new_page_table->walk_cache = NULL;
+    new_page_table->protections = NULL;
+    memset(new_page_table->protection_faults, 0, sizeof(new_page_table->protection_faults));
+    for (uint64_t i = 0; i < page_count; i++) {
+        new_page_table->map[i] = UNMAPPED; /* UNMAPPED == -1 */
+    }
+    return new_page_table;
+}
+
+/**
+ * FUNCTION: create_backing_store()
+ * Opens the backing store file for reading pages. With use_mmap the
+ * whole file is mapped read-only, which suits very large sparse stores
+ * since only the pages that are touched are ever read. Returns NULL if
+ * the file cannot be opened or mapped.
+ * */
+BackingStore* create_backing_store(const char* path, int use_mmap) {
+    int fd = open(path, O_RDONLY);
+    struct stat file_status;
+    if (fd < 0 || fstat(fd, &file_status) != 0) {
+        return NULL;
+    }
+
+    BackingStore* new_backing_store = (BackingStore*)malloc(sizeof(BackingStore));
+    new_backing_store->fd = fd;
+    new_backing_store->size = (uint64_t)file_status.st_size;
+    new_backing_store->mapping = NULL;
+
+    if (use_mmap && new_backing_store->size > 0) {
+        void* mapping = mmap(NULL, new_backing_store->size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            free(new_backing_store);
+            return NULL;
+        }
+        new_backing_store->mapping = (signed char*)mapping;
+    }
+    return new_backing_store;
+}
+
+/**
+ * FUNCTION: read_backing_store_page()
+ * Copies one page from the backing store into destination. The offset is
+ * computed in 64 bits so that stores larger than 2 GiB work. Any part of
+ * the page that lies past the end of the store reads as zeros.
+ * */
+void read_backing_store_page(BackingStore* backing_store, uint64_t page_number, signed char* destination) {
+    uint64_t offset = page_number * PAGE_SIZE;
+    size_t available = 0;
+
+    if (offset < backing_store->size) {
+        available = (backing_store->size - offset < PAGE_SIZE) ? (size_t)(backing_store->size - offset) : PAGE_SIZE;
+    }
+
+    if (backing_store->mapping != NULL) {
+        memcpy(destination, backing_store->mapping + offset, available);
+    } else {
+        size_t done = 0;
+        while (done < available) {
+            ssize_t count = pread(backing_store->fd, destination + done, available - done, (off_t)(offset + done));
+            if (count <= 0) {
+                break;
+            }
+            done += (size_t)count;
+        }
+        available = done;
+    }
+    memset(destination + available, 0, PAGE_SIZE - available);
+}
+
+/**
+ * FUNCTION: close_backing_store()
+ * Unmaps and closes the backing store.
+ * */
+void close_backing_store(BackingStore* backing_store) {
+    if (backing_store->mapping != NULL) {
+        munmap(backing_store->mapping, backing_store->size);
+    }
+    close(backing_store->fd);
+    free(backing_store);
+}
+
+/**
+ * FUNCTION: set_default_options()
+ * Fills in options with the simulator's defaults, before any command line
+ * is read. Defaults that depend on other options, such as the number of
+ * frames, are left at 0 for parse_options() to derive.
+ * */
+void set_default_options(Options* options) {
+    options->input_path = NULL;
+    options->backing_store_path = "BACKING_STORE.bin";
+    options->address_bits = DEFAULT_ADDRESS_BITS;
+    options->frame_count = 0;
+    options->use_mmap = 0;
+    options->policy_name = "fifo";
+    options->output_path = "output.txt";
+    options->timings = 0;
+    options->perf_counters = 0;
+    options->latency_histograms = 0;
+    options->histogram_path = NULL;
+    options->trace_events_path = NULL;
+    options->trace_events_capacity = EVENT_RING_DEFAULT_CAPACITY;
+    options->live_statistics_name = NULL;
+    options->heatmap_path = NULL;
+    options->heatmap_window = HEATMAP_DEFAULT_WINDOW;
+    options->heatmap_binary = 0;
+    options->hot_pages = 0;
+    options->hot_pages_counters = 0;
+    options->prefetcher_name = NULL;
+    options->prefetch_degree = PREFETCH_DEFAULT_DEGREE;
+    options->prefetch_table = 0;
+    options->page_cache_pages = 0;
+    options->fault_around_pages = 0;
+    options->slow_frame_count = 0;
+    options->fast_latency = TIER_DEFAULT_FAST_NS;
+    options->slow_latency = TIER_DEFAULT_SLOW_NS;
+    options->migration_cost = TIER_DEFAULT_MIGRATION_NS;
+    options->promote_threshold = TIER_DEFAULT_PROMOTE_COUNT;
+    options->tier_sample_interval = 1;
+    options->numa_node_count = 0;
+    options->numa_cpu_count = 0;
+    options->numa_policy = NUMA_LOCAL;
+    options->numa_preferred_node = 0;
+    options->numa_quantum = NUMA_DEFAULT_QUANTUM;
+    options->numa_balancing_period = 0;
+    options->local_latency = NUMA_DEFAULT_LOCAL_NS;
+    options->remote_latency = NUMA_DEFAULT_REMOTE_NS;
+    options->caches = 0;
+    options->cache_levels[0] = (CacheGeometry){ 32 << 10, 8, 64 };
+    options->cache_levels[1] = (CacheGeometry){ 256 << 10, 8, 64 };
+    options->cache_levels[2] = (CacheGeometry){ 8 << 20, 16, 64 };
+    options->page_coloring = 0;
+    options->page_colors = 0;
+    options->virtualization = VIRTUALIZATION_NONE;
+    options->guest_page_count = 0;
+    options->guest_policy_name = "fifo";
+    options->nested_tlb_entries = 0;
+    options->walk_cache_entries = 0;
+    options->region_count = 0;
+}
+
+/**
+ * FUNCTION: parse_options()
+ * Reads the simulator's command line into an Options struct. The trace
+ * file is the only positional argument. Without options the simulator
+ * models the classic 16-bit address space with 256 frames and reads
+ * BACKING_STORE.bin. Returns 0 if the command line is invalid.
+ * */
+int parse_options(int argc, char* argv[], Options* options) {
+    set_default_options(options);
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        uint64_t number = 0;
+        if (strcmp(argv[i], "--backing-store") == 0 && value != NULL) {
+            options->backing_store_path = value; i++;
+        } else if (strcmp(argv[i], "--mmap") == 0) {
+            options->use_mmap = 1;
+        } else if (strcmp(argv[i], "--timings") == 0) {
+            options->timings = 1;
+        } else if (strcmp(argv[i], "--perf-counters") == 0) {
+            options->perf_counters = 1;
+        } else if (strcmp(argv[i], "--latency-histograms") == 0) {
+            options->latency_histograms = 1;
+        } else if (strcmp(argv[i], "--histogram-out") == 0 && value != NULL) {
+            options->latency_histograms = 1;
+            options->histogram_path = value; i++;
+        } else if (strcmp(argv[i], "--trace-events") == 0 && value != NULL) {
+            options->trace_events_path = value; i++;
+        } else if (strcmp(argv[i], "--heatmap") == 0 && value != NULL) {
+            options->heatmap_path = value; i++;
+        } else if (strcmp(argv[i], "--heatmap-window") == 0 && value != NULL && parse_count(value, &number) && number > 0) {
+            options->heatmap_window = number; i++;
+        } else if (strcmp(argv[i], "--heatmap-format") == 0 && value != NULL &&
+                   (strcmp(value, "csv") == 0 || strcmp(value, "binary") == 0)) {
+            options->heatmap_binary = strcmp(value, "binary") == 0; i++;
+        } else if (strcmp(argv[i], "--hot-pages") == 0 && value != NULL && atoi(value) > 0) {
+            options->hot_pages = atoi(value); i++;
+        } else if (strcmp(argv[i], "--hot-pages-counters") == 0 && value != NULL && parse_count(value, &number) &&
+                   number > 0 && number < HOT_PAGES_EMPTY / 2) {
+            options->hot_pages_counters = number; i++;
+        } else if (strcmp(argv[i], "--prefetch") == 0 && value != NULL) {
+            options->prefetcher_name = value; i++;
+        } else if (strcmp(argv[i], "--prefetch-degree") == 0 && value != NULL && atoi(value) > 0 && atoi(value) <= PREFETCH_MAX_DEGREE) {
+            options->prefetch_degree = atoi(value); i++;
+        } else if (strcmp(argv[i], "--prefetch-table") == 0 && value != NULL && parse_count(value, &number) && number > 0 && number <= INT32_MAX / 2) {
+            options->prefetch_table = (int)number; i++;
+        } else if (strcmp(argv[i], "--page-cache") == 0 && value != NULL && parse_count(value, &number) && number > 0 && number <= INT32_MAX / 2) {
+            options->page_cache_pages = (int)number; i++;
+        } else if (strcmp(argv[i], "--fault-around") == 0 && value != NULL && parse_count(value, &number) &&
+                   number > 1 && number <= FAULT_AROUND_MAX_PAGES && (number & (number - 1)) == 0) {
+            options->fault_around_pages = (int)number; i++;
+        } else if (strcmp(argv[i], "--slow-frames") == 0 && value != NULL && parse_count(value, &number) && number > 0 && number < INT32_MAX) {
+            options->slow_frame_count = (int)number; i++;
+        } else if (strcmp(argv[i], "--fast-latency") == 0 && value != NULL && atof(value) >= 0.0) {
+            options->fast_latency = atof(value); i++;
+        } else if (strcmp(argv[i], "--slow-latency") == 0 && value != NULL && atof(value) >= 0.0) {
+            options->slow_latency = atof(value); i++;
+        } else if (strcmp(argv[i], "--migration-cost") == 0 && value != NULL && atof(value) >= 0.0) {
+            options->migration_cost = atof(value); i++;
+        } else if (strcmp(argv[i], "--promote-threshold") == 0 && value != NULL && atoi(value) > 0 && atoi(value) < UINT16_MAX) {
+            options->promote_threshold = atoi(value); i++;
+        } else if (strcmp(argv[i], "--tier-sample") == 0 && value != NULL && atoi(value) > 0) {
+            options->tier_sample_interval = atoi(value); i++;
+        } else if (strcmp(argv[i], "--numa-nodes") == 0 && value != NULL && atoi(value) > 0 && atoi(value) <= NUMA_MAX_NODES) {
+            options->numa_node_count = atoi(value); i++;
+        } else if (strcmp(argv[i], "--cpus") == 0 && value != NULL && atoi(value) > 0) {
+            options->numa_cpu_count = atoi(value); i++;
+        } else if (strcmp(argv[i], "--cpu-quantum") == 0 && value != NULL && parse_count(value, &number) && number > 0) {
+            options->numa_quantum = number; i++;
+        } else if (strcmp(argv[i], "--numa-policy") == 0 && value != NULL && strcmp(value, "local") == 0) {
+            options->numa_policy = NUMA_LOCAL; i++;
+        } else if (strcmp(argv[i], "--numa-policy") == 0 && value != NULL && strcmp(value, "interleave") == 0) {
+            options->numa_policy = NUMA_INTERLEAVE; i++;
+        } else if (strcmp(argv[i], "--numa-policy") == 0 && value != NULL && strcmp(value, "preferred") == 0) {
+            options->numa_policy = NUMA_PREFERRED; i++;
+        } else if (strcmp(argv[i], "--numa-preferred") == 0 && value != NULL && atoi(value) >= 0) {
+            options->numa_preferred_node = atoi(value); i++;
+        } else if (strcmp(argv[i], "--numa-balancing") == 0 && value != NULL && parse_count(value, &number) && number > 0) {
+            options->numa_balancing_period = number; i++;
+        } else if (strcmp(argv[i], "--local-latency") == 0 && value != NULL && atof(value) >= 0.0) {
+            options->local_latency = atof(value); i++;
+        } else if (strcmp(argv[i], "--remote-latency") == 0 && value != NULL && atof(value) >= 0.0) {
+            options->remote_latency = atof(value); i++;
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            options->caches = 1;
+        } else if (strcmp(argv[i], "--cache-l1") == 0 && value != NULL && parse_cache_geometry(value, &options->cache_levels[0])) {
+            options->caches = 1; i++;
+        } else if (strcmp(argv[i], "--cache-l2") == 0 && value != NULL && parse_cache_geometry(value, &options->cache_levels[1])) {
+            options->caches = 1; i++;
+        } else if (strcmp(argv[i], "--cache-llc") == 0 && value != NULL && parse_cache_geometry(value, &options->cache_levels[2])) {
+            options->caches = 1; i++;
+        } else if (strcmp(argv[i], "--page-coloring") == 0) {
+            options->page_coloring = 1;
+        } else if (strcmp(argv[i], "--page-colors") == 0 && value != NULL && parse_count(value, &number) && number > 0 && number <= INT32_MAX) {
+            options->page_coloring = 1;
+            options->page_colors = (int)number; i++;
+        } else if (strcmp(argv[i], "--virtualization") == 0 && value != NULL && strcmp(value, "nested") == 0) {
+            options->virtualization = VIRTUALIZATION_NESTED; i++;
+        } else if (strcmp(argv[i], "--virtualization") == 0 && value != NULL && strcmp(value, "shadow") == 0) {
+            options->virtualization = VIRTUALIZATION_SHADOW; i++;
+        } else if (strcmp(argv[i], "--guest-pages") == 0 && value != NULL && parse_count(value, &number) && number > 0 && number <= INT32_MAX) {
+            options->guest_page_count = (int)number; i++;
+        } else if (strcmp(argv[i], "--guest-policy") == 0 && value != NULL) {
+            options->guest_policy_name = value; i++;
+        } else if (strcmp(argv[i], "--nested-tlb") == 0 && value != NULL && parse_count(value, &number) && number <= INT32_MAX / 2) {
+            options->nested_tlb_entries = (int)number; i++;
+        } else if (strcmp(argv[i], "--walk-cache") == 0 && value != NULL && parse_count(value, &number) && number > 0 && number <= INT32_MAX / PAGE_WALK_MAX_LEVELS) {
+            options->walk_cache_entries = (int)number; i++;
+        } else if (strcmp(argv[i], "--region") == 0 && value != NULL && options->region_count < REGION_MAX_COUNT &&
+                   parse_region(value, &options->regions[options->region_count])) {
+            options->region_count++; i++;
+        } else if (strcmp(argv[i], "--live-stats") == 0 && value != NULL) {
+            options->live_statistics_name = value; i++;
+        } else if (strcmp(argv[i], "--trace-events-size") == 0 && value != NULL && parse_count(value, &number) && number > 0) {
+            options->trace_events_capacity = number; i++;
+        } else if (strcmp(argv[i], "--policy") == 0 && value != NULL) {
+            options->policy_name = value; i++;
+        } else if (strcmp(argv[i], "--address-bits") == 0 && value != NULL && parse_count(value, &number) &&
+                   number > PAGE_NUMBER_OFFSET_BITS && number <= MAX_ADDRESS_BITS) {
+            options->address_bits = (int)number; i++;
+        } else if (strcmp(argv[i], "--frames") == 0 && value != NULL && parse_count(value, &number) &&
+                   number > 0 && number <= INT32_MAX) {
+            options->frame_count = (int)number; i++;
+        } else if (argv[i][0] != '-' && options->input_path == NULL) {
+            options->input_path = argv[i];
+        } else {
+            return 0;
+        }
+    }
+
+    /// By default a guest has a guest-physical page for every virtual page.
+    uint64_t page_count = (uint64_t)1 << (options->address_bits - PAGE_NUMBER_OFFSET_BITS);
+    if (options->virtualization != VIRTUALIZATION_NONE && options->guest_page_count == 0) {
+        options->guest_page_count = page_count < INT32_MAX ? (int)page_count : INT32_MAX;
+    }
+
+    /// By default there is one frame for every page (every guest-physical page in a
+    /// virtual machine), so pages are never evicted, up to 256 MiB of frames: a wider
+    /// address space would not fit in memory and needs --frames to size it.
+    if (options->frame_count == 0) {
+        if (options->virtualization != VIRTUALIZATION_NONE) {
+            page_count = (uint64_t)options->guest_page_count;
+        }
+        options->frame_count = page_count < DEFAULT_MAX_FRAMES ? (int)page_count : DEFAULT_MAX_FRAMES;
+    }
+
+    /// By default there is one CPU on every NUMA node.
+    if (options->numa_cpu_count == 0) {
+        options->numa_cpu_count = options->numa_node_count;
+    }
+
+    /// By default pages are colored for the outermost cache level: one color per page of a way.
+    if (options->page_coloring && options->page_colors == 0 && options->caches) {
+        for (int i = 0; i < CACHE_LEVELS; i++) {
+            CacheGeometry* geometry = &options->cache_levels[i];
+            if (geometry->size > 0) {
+                uint64_t way_size = geometry->size / (uint64_t)geometry->ways;
+                options->page_colors = way_size > PAGE_SIZE ? (int)(way_size / PAGE_SIZE) : 1;
+            }
+        }
+    }
+
+    /// More colors than frames would leave colors without a frame of their own.
+    if (options->page_colors > options->frame_count) {
+        options->page_colors = options->frame_count;
+    }
+
+    /// Fault-around only maps pages that are still in memory, so it needs the page cache,
+    /// the slow tier has to leave at least one fast frame, every NUMA node needs a frame,
+    /// page coloring needs a number of colors and cannot be combined with NUMA placement,
+    /// and the page cache would keep the contents of guest-physical pages the guest has reused.
+    return options->input_path != NULL && (options->fault_around_pages == 0 || options->page_cache_pages > 0) &&
+           options->slow_frame_count < options->frame_count && options->numa_node_count <= options->frame_count &&
+           (options->numa_node_count == 0 || options->numa_preferred_node < options->numa_node_count) &&
+           (!options->page_coloring || (options->page_colors > 0 && options->numa_node_count == 0)) &&
+           (options->virtualization == VIRTUALIZATION_NONE || options->page_cache_pages == 0);
+}
+/**
+ * FUNCTION: generate_trace()
+ * Writes a synthetic trace of virtual addresses to a file. The access
+ * pattern, the size of the address space, the number of references and
+ * the seed are all configurable, so the same command always reproduces
+ * the same trace. Traces can be written as text (one decimal address per
+ * line, like addresses.txt) or in the binary trace format.
+ * */
+int generate_trace(int argc, char* argv[]) {
+
+    /// Defaults describe the same 16-bit address space the simulator models.
+    TraceModel model = TRACE_MODEL_UNIFORM;
+    uint64_t count = 1000;
+    uint64_t page_count = PAGE_TABLE_SIZE;
+    uint64_t seed = TRACE_DEFAULT_SEED;
+    uint64_t loop_pages = 0;
+    uint64_t stride_pages = 0;
+    uint64_t phase_length = 0;
+    double zipf_skew = -1.0;
+    int binary = 0;
+    int quiet = 0;
+    const char* mix = NULL;
+    const char* output_path = NULL;
+
+    /// Read the options, leaving the output path as the only positional argument.
+    for (int i = 1; i < argc; i++) {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        int ok = 1;
+        if (strcmp(argv[i], "--model") == 0 && value != NULL) {
+            ok = parse_trace_model(value, &model); i++;
+        } else if (strcmp(argv[i], "--count") == 0 && value != NULL) {
+            ok = parse_count(value, &count); i++;
+        } else if (strcmp(argv[i], "--pages") == 0 && value != NULL) {
+            ok = parse_count(value, &page_count) && page_count > 0; i++;
+        } else if (strcmp(argv[i], "--seed") == 0 && value != NULL) {
+            ok = parse_count(value, &seed); i++;
+        } else if (strcmp(argv[i], "--zipf-skew") == 0 && value != NULL) {
+            zipf_skew = atof(value); ok = zipf_skew > 0.0; i++;
+        } else if (strcmp(argv[i], "--loop-pages") == 0 && value != NULL) {
+            ok = parse_count(value, &loop_pages) && loop_pages > 0; i++;
+        } else if (strcmp(argv[i], "--stride") == 0 && value != NULL) {
+            ok = parse_count(value, &stride_pages) && stride_pages > 0; i++;
+        } else if (strcmp(argv[i], "--mix") == 0 && value != NULL) {
+            mix = value; model = TRACE_MODEL_MIX; i++;
+        } else if (strcmp(argv[i], "--phase-length") == 0 && value != NULL) {
+            ok = parse_count(value, &phase_length) && phase_length > 0; i++;
+        } else if (strcmp(argv[i], "--format") == 0 && value != NULL) {
+            ok = strcmp(value, "text") == 0 || strcmp(value, "binary") == 0;
+            binary = strcmp(value, "binary") == 0; i++;
+        } else if (strcmp(argv[i], "--quiet") == 0) {
+            quiet = 1;
+        } else if (argv[i][0] != '-' && output_path == NULL) {
+            output_path = argv[i];
+        } else {
+            ok = 0;
+        }
+        if (!ok) {
+            printf("Error: invalid generate option '%s'\n", argv[i]);
+            return -1;
+        }
+    }
+
+    if (output_path == NULL || (model == TRACE_MODEL_MIX && mix == NULL)) {
+        printf("Usage: generate [--model uniform|zipf|seq|loop|stride|chase] [--mix model,model,...]\n");
+        printf("                [--count N] [--pages N] [--seed N] [--zipf-skew S] [--loop-pages N]\n");
+        printf("                [--stride N] [--phase-length N] [--format text|binary] [--quiet] trace-file\n");
+        return -1;
+    }
+
+    /// Build the generator, or one sub-generator per phase for a mixture.
+    Random random;
+    seed_random(&random, seed);
+    TraceGenerator* generator = create_trace_generator(model, page_count);
+    if (model == TRACE_MODEL_MIX) {
+        char* names = strdup(mix);
+        for (char* name = strtok(names, ","); name != NULL; name = strtok(NULL, ",")) {
+            TraceModel phase_model;
+            if (!parse_trace_model(name, &phase_model) || phase_model == TRACE_MODEL_MIX ||
+                generator->phase_count == TRACE_MAX_MIX_MODELS) {
+                printf("Error: invalid mix model '%s'\n", name);
+                return -1;
+            }
+            generator->phases[generator->phase_count++] = create_trace_generator(phase_model, page_count);
+        }
+        free(names);
+    }
+
+    /// Apply the model parameters to the generator and each of its phases.
+    for (int i = -1; i < generator->phase_count; i++) {
+        TraceGenerator* target = (i < 0) ? generator : generator->phases[i];
+        if (loop_pages > 0) {
+            target->loop_pages = loop_pages < page_count ? loop_pages : page_count;
+        }
+        if (stride_pages > 0) {
+            target->stride_pages = stride_pages;
+        }
+        if (zipf_skew > 0.0) {
+            target->zipf_skew = zipf_skew;
+        }
+    }
+    if (phase_length > 0) {
+        generator->phase_length = phase_length;
+    }
+    prepare_trace_generator(generator, &random);
+
+    FILE* output_file = fopen(output_path, binary ? "wb" : "w");
+    if (output_file == NULL) {
+        printf("Error: unable to open %s\n", output_path);
+        return -2;
+    }
+
+    /// Fill a large buffer with formatted references and write it out in blocks,
+    /// so that traces of billions of references are limited by disk speed.
+    unsigned char* buffer = (unsigned char*)malloc(TRACE_WRITE_BUFFER_SIZE);
+    size_t used = 0;
+    if (binary) {
+        memcpy(buffer, TRACE_BINARY_MAGIC, TRACE_BINARY_MAGIC_SIZE);
+        used = TRACE_BINARY_MAGIC_SIZE;
+    }
+
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t page = next_trace_page(generator, &random);
+        uint64_t address = (page << PAGE_NUMBER_OFFSET_BITS) | next_random_below(&random, PAGE_SIZE);
+
+        if (binary) {
+            for (int byte = 0; byte < 8; byte++) {
+                buffer[used++] = (unsigned char)(address >> (8 * byte));
+            }
+        } else {
+            /// Format the decimal digits backwards, then copy them in order.
+            char digits[24];
+            int length = 0;
+            do {
+                digits[length++] = (char)('0' + address % 10);
+                address /= 10;
+            } while (address != 0);
+            while (length > 0) {
+                buffer[used++] = (unsigned char)digits[--length];
+            }
+            buffer[used++] = '\n';
+        }
+
+        if (used > TRACE_WRITE_BUFFER_SIZE - 32) {
+            fwrite(buffer, 1, used, output_file);
+            used = 0;
+        }
+    }
+    fwrite(buffer, 1, used, output_file);
+
+    if (fclose(output_file) != 0) {
+        printf("Error: unable to write %s\n", output_path);
+        return -2;
+    }
+    free(buffer);
+    if (!quiet) {
+        printf("Successfully generated trace file '%s'\n", output_path);
+    }
+    return 0;
+}
+
+/**
+ * FUNCTION: parse_trace_model()
+ * Converts a model name from the command line into a TraceModel.
+ * Returns 0 if the name is not a known model.
+ * */
+int parse_trace_model(const char* name, TraceModel* model) {
+    static const char* names[] = { "uniform", "zipf", "seq", "loop", "stride", "chase", "mix" };
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+        if (strcmp(name, names[i]) == 0) {
+            *model = (TraceModel)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * FUNCTION: parse_count()
+ * Converts a non-negative count from the command line, accepting the
+ * decimal suffixes K, M, G (or B) for thousands, millions and billions.
+ * Returns 0 if the text is not a valid count.
+ * */
+int parse_count(const char* text, uint64_t* count) {
+    char* end = NULL;
+    if (text[0] == '-') {
+        return 0;
+    }
+    uint64_t value = strtoull(text, &end, 0);
+    if (end == text) {
+        return 0;
+    }
+    if (*end == 'K' || *end == 'k') {
+        value *= 1000ULL; end++;
+    } else if (*end == 'M' || *end == 'm') {
+        value *= 1000000ULL; end++;
+    } else if (*end == 'G' || *end == 'g' || *end == 'B' || *end == 'b') {
+        value *= 1000000000ULL; end++;
+    }
+    *count = value;
+    return *end == '\0';
+}
+
+/**
+ * FUNCTION: create_trace_generator()
+ * Creates a generator for one access model over page_count pages, with
+ * default model parameters. prepare_trace_generator() must be called once
+ * the parameters are final and before the first page is drawn.
+ * */
+TraceGenerator* create_trace_generator(TraceModel model, uint64_t page_count) {
+    TraceGenerator* new_generator = (TraceGenerator*)calloc(1, sizeof(TraceGenerator));
+    new_generator->model = model;
+    new_generator->page_count = page_count;
+    new_generator->zipf_skew = 0.99;
+    new_generator->loop_pages = page_count < 64 ? page_count : 64;
+    new_generator->stride_pages = 4;
+    new_generator->phase_length = 100000;
+    return new_generator;
+}
+
+/**
+ * FUNCTION: zipf_helper_log() / zipf_helper_exp() and friends
+ * Numerically stable helpers for the rejection-inversion Zipf sampler
+ * (Hormann and Derflinger, 1996), which draws a Zipf rank in O(1) time
+ * and O(1) memory regardless of how many pages there are.
+ * */
+static double zipf_helper_log(double x) {
+    return (fabs(x) > 1e-8) ? log1p(x) / x : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+}
+
+static double zipf_helper_exp(double x) {
+    return (fabs(x) > 1e-8) ? expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x * (1.0 / 3.0) * (1.0 + 0.25 * x));
+}
+
+static double zipf_h(double skew, double x) {
+    return exp(-skew * log(x));
+}
+
+static double zipf_h_integral(double skew, double x) {
+    double log_x = log(x);
+    return zipf_helper_exp((1.0 - skew) * log_x) * log_x;
+}
+
+static double zipf_h_integral_inverse(double skew, double x) {
+    double t = x * (1.0 - skew);
+    if (t < -1.0) {
+        t = -1.0;
+    }
+    return exp(zipf_helper_log(t) * x);
+}
+
+/**
+ * FUNCTION: prepare_trace_generator()
+ * Computes the state derived from the model parameters: the Zipf sampler
+ * constants and, for pointer chasing, a random single cycle through all
+ * pages (Sattolo's algorithm) so that every page is visited once per lap.
+ * */
+void prepare_trace_generator(TraceGenerator* generator, Random* random) {
+    double skew = generator->zipf_skew;
+    double n = (double)generator->page_count;
+    generator->zipf_h_integral_x1 = zipf_h_integral(skew, 1.5) - 1.0;
+    generator->zipf_h_integral_n = zipf_h_integral(skew, n + 0.5);
+    generator->zipf_s = 2.0 - zipf_h_integral_inverse(skew, zipf_h_integral(skew, 2.5) - zipf_h(skew, 2.0));
+
+    if (generator->model == TRACE_MODEL_CHASE && generator->chase_next == NULL) {
+        uint64_t* order = (uint64_t*)malloc(sizeof(uint64_t) * generator->page_count);
+        generator->chase_next = (uint64_t*)malloc(sizeof(uint64_t) * generator->page_count);
+        for (uint64_t i = 0; i < generator->page_count; i++) {
+            order[i] = i;
+        }
+        for (uint64_t i = generator->page_count - 1; i > 0; i--) {
+            uint64_t j = next_random_below(random, i);
+            uint64_t swap = order[i];
+            order[i] = order[j];
+            order[j] = swap;
+        }
+        for (uint64_t i = 0; i < generator->page_count; i++) {
+            generator->chase_next[order[i]] = order[(i + 1) % generator->page_count];
+        }
+        generator->position = order[0];
+        free(order);
+    }
+
+    for (int i = 0; i < generator->phase_count; i++) {
+        prepare_trace_generator(generator->phases[i], random);
+    }
+}
+
+/**
+ * FUNCTION: next_trace_page()
+ * Draws the page number of the next reference from the generator's model.
+ * */
+uint64_t next_trace_page(TraceGenerator* generator, Random* random) {
+    uint64_t page = 0;
+
+    switch (generator->model) {
+    case TRACE_MODEL_UNIFORM:
+        page = next_random_below(random, generator->page_count);
+        break;
+
+    case TRACE_MODEL_ZIPF: {
+        /// Rejection-inversion: rank 1 is the hottest page (page 0).
+        double skew = generator->zipf_skew;
+        for (;;) {
+            double u = generator->zipf_h_integral_n + next_random_double(random) * (generator->zipf_h_integral_x1 - generator->zipf_h_integral_n);
+            double x = zipf_h_integral_inverse(skew, u);
+            double k = floor(x + 0.5);
+            if (k < 1.0) {
+                k = 1.0;
+            } else if (k > (double)generator->page_count) {
+                k = (double)generator->page_count;
+            }
+            if (k - x <= generator->zipf_s || u >= zipf_h_integral(skew, k + 0.5) - zipf_h(skew, k)) {
+                page = (uint64_t)k - 1;
+                break;
+            }
+        }
+        break;
+    }
+
+    case TRACE_MODEL_SEQUENTIAL:
+        page = generator->position % generator->page_count;
+        generator->position++;
+        break;
+
+    case TRACE_MODEL_LOOP:
+        page = generator->position % generator->loop_pages;
+        generator->position++;
+        break;
+
+    case TRACE_MODEL_STRIDE:
+        page = (generator->position * generator->stride_pages) % generator->page_count;
+        generator->position++;
+        break;
+
+    case TRACE_MODEL_CHASE:
+        page = generator->position;
+        generator->position = generator->chase_next[page];
+        break;
+
+    case TRACE_MODEL_MIX:
+        /// Move on to the next model in the mixture once the phase is over.
+        if (generator->phase_position == generator->phase_length) {
+            generator->phase_index = (generator->phase_index + 1) % generator->phase_count;
+            generator->phase_position = 0;
+        }
+        generator->phase_position++;
+        page = next_trace_page(generator->phases[generator->phase_index], random);
+        break;
+    }
+    return page;
+}
+
+/**
+ * FUNCTION: seed_random()
+ * Seeds the generator state from a single 64-bit seed using splitmix64.
+ * */
+void seed_random(Random* random, uint64_t seed) {
+    for (int i = 0; i < 4; i++) {
+        seed += 0x9E3779B97F4A7C15ULL;
+        uint64_t z = seed;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        random->state[i] = z ^ (z >> 31);
+    }
+}
+
+/**
+ * FUNCTION: next_random()
+ * Returns the next 64 random bits (xoshiro256**).
+ * */
+uint64_t next_random(Random* random) {
+    uint64_t* s = random->state;
+    uint64_t result = s[1] * 5;
+    result = ((result << 7) | (result >> 57)) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+    return result;
+}
+
+/**
+ * FUNCTION: next_random_below()
+ * Returns a random integer in [0, bound) using a multiply-shift reduction.
+ * */
+uint64_t next_random_below(Random* random, uint64_t bound) {
+    return (uint64_t)(((unsigned __int128)next_random(random) * bound) >> 64);
+}
+
+/**
+ * FUNCTION: next_random_double()
+ * Returns a random double in [0, 1) with 53 bits of precision.
+ * */
+double next_random_double(Random* random) {
+    return (double)(next_random(random) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * FUNCTION: make_backing_store()
+ * Writes a backing store of any size as a sparse file. The file is first
+ * extended to its full size, which leaves it as one big hole that reads
+ * as zeros, and then a deterministic fraction of its pages (--density)
+ * is filled with bytes derived from the seed and the page number. The
+ * same options always produce the same content, and only the filled
+ * pages take up disk space.
+ * */
+int make_backing_store(int argc, char* argv[]) {
+    uint64_t size = 65536;
+    uint64_t seed = TRACE_DEFAULT_SEED;
+    double density = STORE_DEFAULT_DENSITY;
+    const char* output_path = NULL;
+
+    /// Read the options, leaving the output path as the only positional argument.
+    for (int i = 1; i < argc; i++) {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        int ok = 1;
+        if (strcmp(argv[i], "--size") == 0 && value != NULL) {
+            ok = parse_size(value, &size) && size > 0; i++;
+        } else if (strcmp(argv[i], "--seed") == 0 && value != NULL) {
+            ok = parse_count(value, &seed); i++;
+        } else if (strcmp(argv[i], "--density") == 0 && value != NULL) {
+            density = atof(value); ok = density >= 0.0 && density <= 1.0; i++;
+        } else if (argv[i][0] != '-' && output_path == NULL) {
+            output_path = argv[i];
+        } else {
+            ok = 0;
+        }
+        if (!ok) {
+            printf("Error: invalid mkstore option '%s'\n", argv[i]);
+            return -1;
+        }
+    }
+
+    if (output_path == NULL) {
+        printf("Usage: mkstore [--size N[K|M|G|T]] [--density 0..1] [--seed N] store-file\n");
+        return -1;
+    }
+
+    int fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, (off_t)size) != 0) {
+        printf("Error: unable to create %s\n", output_path);
+        return -2;
+    }
+
+    /// Decide page by page whether to fill it, using a hash of the page number
+    /// so that the selection does not depend on the order pages are visited in.
+    uint64_t page_count = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint64_t threshold = (density >= 1.0) ? UINT64_MAX : (uint64_t)(density * 18446744073709549568.0);
+    uint64_t filled = 0;
+    signed char page[PAGE_SIZE];
+
+    for (uint64_t page_number = 0; page_number < page_count; page_number++) {
+        Random random;
+        seed_random(&random, seed ^ (page_number * 0xD1B54A32D192ED03ULL));
+        if (next_random(&random) > threshold || threshold == 0) {
+            continue;
+        }
+
+        for (int i = 0; i < PAGE_SIZE; i += 8) {
+            uint64_t bits = next_random(&random);
+            memcpy(page + i, &bits, 8);
+        }
+
+        uint64_t offset = page_number * PAGE_SIZE;
+        size_t length = (size - offset < PAGE_SIZE) ? (size_t)(size - offset) : PAGE_SIZE;
+        if (pwrite(fd, page, length, (off_t)offset) != (ssize_t)length) {
+            printf("Error: unable to write %s\n", output_path);
+            close(fd);
+            return -2;
+        }
+        filled++;
+    }
+
+    close(fd);
+    printf("Successfully generated backing store '%s' (%" PRIu64 " pages, %" PRIu64 " filled)\n", output_path, page_count, filled);
+    return 0;
+}
+
+/**
+ * FUNCTION: parse_size()
+ * Converts a size in bytes from the command line, accepting the binary
+ * suffixes K, M, G and T. Returns 0 if the text is not a valid size.
+ * */
+int parse_size(const char* text, uint64_t* size) {
+    char* end = NULL;
+    if (text[0] == '-') {
+        return 0;
+    }
+    uint64_t value = strtoull(text, &end, 0);
+    if (end == text) {
+        return 0;
+    }
+    static const char suffixes[] = "KMGT";
+    for (int i = 0; i < 4; i++) {
+        if (*end == suffixes[i] || *end == suffixes[i] + ('a' - 'A')) {
+            value <<= 10 * (i + 1);
+            end++;
+            break;
+        }
+    }
+    *size = value;
+    return *end == '\0';
+}
+
+/**
+ * FUNCTION: create_replacement_policy()
+ * Creates the replacement policy with the given name for frame_count
+ * frames. Returns NULL if there is no policy with that name.
+ * */
+ReplacementPolicy* create_replacement_policy(const char* name, int frame_count) {
+    for (int i = 0; replacement_policies[i].name != NULL; i++) {
+        if (strcmp(name, replacement_policies[i].name) == 0) {
+            ReplacementPolicy* new_policy = replacement_policies[i].create(frame_count);
+            new_policy->name = replacement_policies[i].name;
+            return new_policy;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * STRUCT: FifoPolicy
+ * First in, first out. A ring of frame numbers in the order their pages
+ * were installed: the victim is the frame at the head, and a refilled
+ * frame joins at the tail. Free frames can be handed out in any order
+ * (by NUMA placement or page coloring), so the order is recorded rather
+ * than assumed from the frame numbers.
+ * */
+struct FifoPolicy {
+    int frame_count;
+    int head;
+    int size;
+    int* order;
+} typedef FifoPolicy;
+
+static void fifo_install(void* state, int frame_number, uint64_t page_number) {
+    FifoPolicy* fifo = (FifoPolicy*)state;
+    (void)page_number;
+    int tail = fifo->head + fifo->size++;
+    fifo->order[tail < fifo->frame_count ? tail : tail - fifo->frame_count] = frame_number;
+}
+
+static int fifo_victim(void* state) {
+    FifoPolicy* fifo = (FifoPolicy*)state;
+    int frame_number = fifo->order[fifo->head];
+    fifo->head = fifo->head + 1 < fifo->frame_count ? fifo->head + 1 : 0;
+    fifo->size--;
+    return frame_number;
+}
+
+/**
+ * FUNCTION: create_fifo_policy()
+ * Creates a first in, first out replacement policy.
+ * */
+ReplacementPolicy* create_fifo_policy(int frame_count) {
+    FifoPolicy* fifo = (FifoPolicy*)calloc(1, sizeof(FifoPolicy));
+    fifo->frame_count = frame_count;
+    fifo->order = (int*)malloc(sizeof(int) * frame_count);
+
+    ReplacementPolicy* new_policy = (ReplacementPolicy*)calloc(1, sizeof(ReplacementPolicy));
+    new_policy->state = fifo;
+    new_policy->access = NULL;
+    new_policy->install = fifo_install;
+    new_policy->victim = fifo_victim;
+    return new_policy;
+}
+
+static void init_frame_list(FrameList* list, int* prev, int* next) {
+    list->head = UNMAPPED;
+    list->tail = UNMAPPED;
+    list->size = 0;
+    list->prev = prev;
+    list->next = next;
+}
+
+static inline void push_frame_list(FrameList* list, int frame_number) {
+    list->prev[frame_number] = UNMAPPED;
+    list->next[frame_number] = list->head;
+    if (list->head != UNMAPPED) {
+        list->prev[list->head] = frame_number;
+    } else {
+        list->tail = frame_number;
+    }
+    list->head = frame_number;
+    list->size++;
+}
+
+static inline void remove_frame_list(FrameList* list, int frame_number) {
+    int prev = list->prev[frame_number];
+    int next = list->next[frame_number];
+    if (prev != UNMAPPED) {
+        list->next[prev] = next;
+    } else {
+        list->head = next;
+    }
+    if (next != UNMAPPED) {
+        list->prev[next] = prev;
+    } else {
+        list->tail = prev;
+    }
+    list->size--;
+}
+
+/**
+ * STRUCT: LruPolicy
+ * Least recently used. Every access moves its frame to the head of the
+ * list, and the victim is the frame at the tail.
+ * */
+struct LruPolicy {
+    FrameList list;
+} typedef LruPolicy;
+
+static void lru_access(void* state, int frame_number, uint64_t page_number) {
+    LruPolicy* lru = (LruPolicy*)state;
+    (void)page_number;
+    if (lru->list.head != frame_number) {
+        remove_frame_list(&lru->list, frame_number);
+        push_frame_list(&lru->list, frame_number);
+    }
+}
+
+static void lru_install(void* state, int frame_number, uint64_t page_number) {
+    LruPolicy* lru = (LruPolicy*)state;
+    (void)page_number;
+    push_frame_list(&lru->list, frame_number);
+}
+
+static int lru_victim(void* state) {
+    LruPolicy* lru = (LruPolicy*)state;
+    int frame_number = lru->list.tail;
+    remove_frame_list(&lru->list, frame_number);
+    return frame_number;
+}
+
+/**
+ * FUNCTION: create_lru_policy()
+ * Creates a least recently used replacement policy.
+ * */
+ReplacementPolicy* create_lru_policy(int frame_count) {
+    LruPolicy* lru = (LruPolicy*)calloc(1, sizeof(LruPolicy));
+    init_frame_list(&lru->list, (int*)malloc(sizeof(int) * frame_count), (int*)malloc(sizeof(int) * frame_count));
+
+    ReplacementPolicy* new_policy = (ReplacementPolicy*)calloc(1, sizeof(ReplacementPolicy));
+    new_policy->state = lru;
+    new_policy->access = lru_access;
+    new_policy->install = lru_install;
+    new_policy->victim = lru_victim;
+    return new_policy;
+}
+
+/**
+ * STRUCT: FrequencySketch
+ * A count-min sketch of recent page access frequencies: four rows of
+ * saturating 8-bit counters, eight to a word. Once sample_size accesses
+ * have been counted every counter is halved, so that old popularity
+ * fades and the sketch follows the workload.
+ * */
+struct FrequencySketch {
+    uint64_t* words;
+    uint64_t counter_mask;
+    uint64_t additions;
+    uint64_t sample_size;
+} typedef FrequencySketch;
+
+static void init_frequency_sketch(FrequencySketch* sketch, int frame_count) {
+    uint64_t counter_count = 64;
+    while (counter_count < (uint64_t)frame_count * 4) {
+        counter_count <<= 1;
+    }
+    sketch->words = (uint64_t*)calloc(counter_count / 8, sizeof(uint64_t));
+    sketch->counter_mask = counter_count - 1;
+    sketch->additions = 0;
+    sketch->sample_size = (uint64_t)frame_count * 10;
+}
+
+/// Returns the counter index of a page in one row of the sketch.
+static inline uint64_t sketch_index(FrequencySketch* sketch, uint64_t page_number, int row) {
+    static const uint64_t seeds[4] = { 0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL, 0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL };
+    uint64_t hash = (page_number + 1) * seeds[row];
+    return (hash ^ (hash >> 29)) & sketch->counter_mask;
+}
+
+static inline int sketch_counter(FrequencySketch* sketch, uint64_t index) {
+    return (int)((sketch->words[index >> 3] >> ((index & 7) * 8)) & 0xff);
+}
+
+static int estimate_frequency(FrequencySketch* sketch, uint64_t page_number) {
+    int frequency = 255;
+    for (int row = 0; row < 4; row++) {
+        int count = sketch_counter(sketch, sketch_index(sketch, page_number, row));
+        frequency = count < frequency ? count : frequency;
+    }
+    return frequency;
+}
+
+static void increment_frequency(FrequencySketch* sketch, uint64_t page_number) {
+    int added = 0;
+    for (int row = 0; row < 4; row++) {
+        uint64_t index = sketch_index(sketch, page_number, row);
+        if (sketch_counter(sketch, index) < 255) {
+            sketch->words[index >> 3] += (uint64_t)1 << ((index & 7) * 8);
+            added = 1;
+        }
+    }
+
+    /// Halve every counter once enough accesses have been seen, eight counters per word at a time.
+    if (added && ++sketch->additions == sketch->sample_size) {
+        for (uint64_t i = 0; i <= sketch->counter_mask / 8; i++) {
+            sketch->words[i] = (sketch->words[i] >> 1) & 0x7F7F7F7F7F7F7F7FULL;
+        }
+        sketch->additions /= 2;
+    }
+}
+
+/**
+ * STRUCT: TinyLfuPolicy
+ * W-TinyLFU. New pages enter a small LRU window (1% of the frames); the
+ * rest of memory is a segmented LRU whose protected segment holds 80%
+ * of it and whose probation segment holds the remainder. When memory is
+ * full, the window's oldest page competes with the probation victim and
+ * the one the frequency sketch has seen less often is evicted.
+ * */
+enum TinyLfuRegion {
+    TINYLFU_WINDOW,
+    TINYLFU_PROBATION,
+    TINYLFU_PROTECTED
+} typedef TinyLfuRegion;
+
+struct TinyLfuPolicy {
+    int window_capacity;
+    int protected_capacity;
+    FrameList window;
+    FrameList probation;
+    FrameList protected_list;
+    unsigned char* regions;
+    uint64_t* frame_pages;
+    FrequencySketch sketch;
+} typedef TinyLfuPolicy;
+
+/// Moves the window's oldest page into the main region's probation segment.
+static void tinylfu_admit(TinyLfuPolicy* tinylfu) {
+    int frame_number = tinylfu->window.tail;
+    remove_frame_list(&tinylfu->window, frame_number);
+    push_frame_list(&tinylfu->probation, frame_number);
+    tinylfu->regions[frame_number] = TINYLFU_PROBATION;
+}
+
+static void tinylfu_access(void* state, int frame_number, uint64_t page_number) {
+    TinyLfuPolicy* tinylfu = (TinyLfuPolicy*)state;
+    increment_frequency(&tinylfu->sketch, page_number);
+
+    switch (tinylfu->regions[frame_number]) {
+        case TINYLFU_WINDOW:
+            remove_frame_list(&tinylfu->window, frame_number);
+            push_frame_list(&tinylfu->window, frame_number);
+            break;
+        case TINYLFU_PROBATION:
+            /// A second hit promotes the page, demoting the oldest protected page if that segment is full.
+            remove_frame_list(&tinylfu->probation, frame_number);
+            push_frame_list(&tinylfu->protected_list, frame_number);
+            tinylfu->regions[frame_number] = TINYLFU_PROTECTED;
+            if (tinylfu->protected_list.size > tinylfu->protected_capacity) {
+                int demoted = tinylfu->protected_list.tail;
+                remove_frame_list(&tinylfu->protected_list, demoted);
+                push_frame_list(&tinylfu->probation, demoted);
+                tinylfu->regions[demoted] = TINYLFU_PROBATION;
+            }
+            break;
+        default:
+            remove_frame_list(&tinylfu->protected_list, frame_number);
+            push_frame_list(&tinylfu->protected_list, frame_number);
+            break;
+    }
+}
+
+static void tinylfu_install(void* state, int frame_number, uint64_t page_number) {
+    TinyLfuPolicy* tinylfu = (TinyLfuPolicy*)state;
+    increment_frequency(&tinylfu->sketch, page_number);
+    tinylfu->frame_pages[frame_number] = page_number;
+    tinylfu->regions[frame_number] = TINYLFU_WINDOW;
+    push_frame_list(&tinylfu->window, frame_number);
+
+    /// While memory is still filling up, pages overflowing the window are admitted without a contest.
+    if (tinylfu->window.size > tinylfu->window_capacity) {
+        tinylfu_admit(tinylfu);
+    }
+}
+
+static int tinylfu_victim(void* state) {
+    TinyLfuPolicy* tinylfu = (TinyLfuPolicy*)state;
+    FrameList* main_list = tinylfu->probation.size > 0 ? &tinylfu->probation : &tinylfu->protected_list;
+    int candidate = tinylfu->window.tail;
+    int victim = main_list->tail;
+
+    /// With one region empty there is nothing to compare.
+    if (candidate == UNMAPPED || victim == UNMAPPED) {
+        FrameList* list = candidate != UNMAPPED ? &tinylfu->window : main_list;
+        int frame_number = list->tail;
+        remove_frame_list(list, frame_number);
+        return frame_number;
+    }
+
+    /// The window's oldest page replaces the main victim only if it is seen more often.
+    if (estimate_frequency(&tinylfu->sketch, tinylfu->frame_pages[candidate]) >
+        estimate_frequency(&tinylfu->sketch, tinylfu->frame_pages[victim])) {
+        remove_frame_list(main_list, victim);
+        tinylfu_admit(tinylfu);
+        return victim;
+    }
+    remove_frame_list(&tinylfu->window, candidate);
+    return candidate;
+}
+
+/**
+ * FUNCTION: create_tinylfu_policy()
+ * Creates a W-TinyLFU replacement policy.
+ * */
+ReplacementPolicy* create_tinylfu_policy(int frame_count) {
+    TinyLfuPolicy* tinylfu = (TinyLfuPolicy*)calloc(1, sizeof(TinyLfuPolicy));
+    int* prev = (int*)malloc(sizeof(int) * frame_count);
+    int* next = (int*)malloc(sizeof(int) * frame_count);
+    tinylfu->window_capacity = frame_count / 100 > 0 ? frame_count / 100 : 1;
+    tinylfu->protected_capacity = (frame_count - tinylfu->window_capacity) * 4 / 5;
+    init_frame_list(&tinylfu->window, prev, next);
+    init_frame_list(&tinylfu->probation, prev, next);
+    init_frame_list(&tinylfu->protected_list, prev, next);
+    tinylfu->regions = (unsigned char*)calloc(frame_count, sizeof(unsigned char));
+    tinylfu->frame_pages = (uint64_t*)calloc(frame_count, sizeof(uint64_t));
+    init_frequency_sketch(&tinylfu->sketch, frame_count);
+
+    ReplacementPolicy* new_policy = (ReplacementPolicy*)calloc(1, sizeof(ReplacementPolicy));
+    new_policy->state = tinylfu;
+    new_policy->access = tinylfu_access;
+    new_policy->install = tinylfu_install;
+    new_policy->victim = tinylfu_victim;
+    return new_policy;
+}
+
+/**
+ * STRUCT: AgingPolicy
+ * Aging (NFU with a reference history), the usual cheap approximation
+ * of LRU. Each frame has a 16-bit history; an access sets the frame's
+ * reference bit, and every tick (frame_count / AGING_TICK_DIVISOR
+ * policy operations) the histories are shifted right with the reference
+ * bits ORed into the top bit. The victim is the frame with the smallest
+ * history, counting the reference bits of the tick in progress.
+ * The reference bits are kept as 0x8000 or 0 in an array of their own,
+ * so the shift and the minimum search work on eight 16-bit lanes at a
+ * time with SSE2 where it is available.
+ * */
+struct AgingPolicy {
+    int frame_count;
+    int tick_interval;
+    int operations;
+    uint16_t* history;
+    uint16_t* referenced;
+} typedef AgingPolicy;
+
+/// Shifts every frame's history right by one, taking in its reference bit.
+static void aging_tick(AgingPolicy* aging) {
+    uint16_t* history = aging->history;
+    uint16_t* referenced = aging->referenced;
+    int i = 0;
+#ifdef __SSE2__
+    for (; i + 8 <= aging->frame_count; i += 8) {
+        __m128i lanes = _mm_loadu_si128((const __m128i*)&history[i]);
+        __m128i bits = _mm_loadu_si128((const __m128i*)&referenced[i]);
+        _mm_storeu_si128((__m128i*)&history[i], _mm_or_si128(_mm_srli_epi16(lanes, 1), bits));
+        _mm_storeu_si128((__m128i*)&referenced[i], _mm_setzero_si128());
+    }
+#endif
+    for (; i < aging->frame_count; i++) {
+        history[i] = (uint16_t)((history[i] >> 1) | referenced[i]);
+        referenced[i] = 0;
+    }
+}
+
+static inline void aging_count_operation(AgingPolicy* aging) {
+    if (++aging->operations == aging->tick_interval) {
+        aging->operations = 0;
+        aging_tick(aging);
+    }
+}
+
+static void aging_access(void* state, int frame_number, uint64_t page_number) {
+    AgingPolicy* aging = (AgingPolicy*)state;
+    (void)page_number;
+    aging->referenced[frame_number] = 0x8000;
+    aging_count_operation(aging);
+}
+
+static void aging_install(void* state, int frame_number, uint64_t page_number) {
+    AgingPolicy* aging = (AgingPolicy*)state;
+    (void)page_number;
+    aging->history[frame_number] = 0;
+    aging->referenced[frame_number] = 0x8000;
+    aging_count_operation(aging);
+}
+
+static int aging_victim(void* state) {
+    AgingPolicy* aging = (AgingPolicy*)state;
+    const uint16_t* history = aging->history;
+    const uint16_t* referenced = aging->referenced;
+    uint16_t minimum = UINT16_MAX;
+    int i = 0;
+
+    /// Find the smallest history as of now, then the first frame holding it.
+#ifdef __SSE2__
+    /// SSE2 only compares signed lanes, so the histories are biased by 0x8000 first.
+    __m128i bias = _mm_set1_epi16((short)0x8000);
+    __m128i lowest = _mm_set1_epi16(INT16_MAX);
+    for (; i + 8 <= aging->frame_count; i += 8) {
+        __m128i lanes = _mm_or_si128(_mm_srli_epi16(_mm_loadu_si128((const __m128i*)&history[i]), 1),
+                                     _mm_loadu_si128((const __m128i*)&referenced[i]));
+        lowest = _mm_min_epi16(lowest, _mm_xor_si128(lanes, bias));
+    }
+    uint16_t lane_minimums[8];
+    _mm_storeu_si128((__m128i*)lane_minimums, _mm_xor_si128(lowest, bias));
+    for (int lane = 0; lane < 8; lane++) {
+        minimum = lane_minimums[lane] < minimum ? lane_minimums[lane] : minimum;
+    }
+#endif
+    for (; i < aging->frame_count; i++) {
+        uint16_t age = (uint16_t)((history[i] >> 1) | referenced[i]);
+        minimum = age < minimum ? age : minimum;
+    }
+
+    int frame_number = 0;
+#ifdef __SSE2__
+    __m128i target = _mm_set1_epi16((short)minimum);
+    for (; frame_number + 8 <= aging->frame_count; frame_number += 8) {
+        __m128i lanes = _mm_or_si128(_mm_srli_epi16(_mm_loadu_si128((const __m128i*)&history[frame_number]), 1),
+                                     _mm_loadu_si128((const __m128i*)&referenced[frame_number]));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(lanes, target));
+        if (mask != 0) {
+            return frame_number + __builtin_ctz((unsigned)mask) / 2;
+        }
+    }
+#endif
+    while ((uint16_t)((history[frame_number] >> 1) | referenced[frame_number]) != minimum) {
+        frame_number++;
+    }
+    return frame_number;
+}
+
+/**
+ * FUNCTION: create_aging_policy()
+ * Creates an aging replacement policy with a 16-bit history per frame.
+ * */
+ReplacementPolicy* create_aging_policy(int frame_count) {
+    AgingPolicy* aging = (AgingPolicy*)calloc(1, sizeof(AgingPolicy));
+    aging->frame_count = frame_count;
+    aging->tick_interval = frame_count / AGING_TICK_DIVISOR > 0 ? frame_count / AGING_TICK_DIVISOR : 1;
+    aging->history = (uint16_t*)calloc(frame_count, sizeof(uint16_t));
+    aging->referenced = (uint16_t*)calloc(frame_count, sizeof(uint16_t));
+
+    ReplacementPolicy* new_policy = (ReplacementPolicy*)calloc(1, sizeof(ReplacementPolicy));
+    new_policy->state = aging;
+    new_policy->access = aging_access;
+    new_policy->install = aging_install;
+    new_policy->victim = aging_victim;
+    return new_policy;
+}
+
+static void init_page_index(PageIndex* index, int entry_count) {
+    index->bits = 1;
+    while ((1LL << index->bits) < 2LL * entry_count) {
+        index->bits++;
+    }
+    index->slots = (int*)malloc(sizeof(int) << index->bits);
+    memset(index->slots, 0xff, sizeof(int) << index->bits);
+}
+
+static inline uint64_t page_index_slot(PageIndex* index, uint64_t page_number) {
+    return (page_number * 0x9E3779B97F4A7C15ULL) >> (64 - index->bits);
+}
+
+/// Returns the entry holding page_number, or UNMAPPED.
+static int find_page_index(PageIndex* index, const uint64_t* pages, uint64_t page_number) {
+    uint64_t mask = ((uint64_t)1 << index->bits) - 1;
+    for (uint64_t slot = page_index_slot(index, page_number); index->slots[slot] != UNMAPPED; slot = (slot + 1) & mask) {
+        if (pages[index->slots[slot]] == page_number) {
+            return index->slots[slot];
+        }
+    }
+    return UNMAPPED;
+}
+
+static void insert_page_index(PageIndex* index, const uint64_t* pages, int entry) {
+    uint64_t mask = ((uint64_t)1 << index->bits) - 1;
+    uint64_t slot = page_index_slot(index, pages[entry]);
+    while (index->slots[slot] != UNMAPPED) {
+        slot = (slot + 1) & mask;
+    }
+    index->slots[slot] = entry;
+}
+
+/// Removes an entry, shifting back later entries of its probe run.
+static void remove_page_index(PageIndex* index, const uint64_t* pages, int entry) {
+    uint64_t mask = ((uint64_t)1 << index->bits) - 1;
+    uint64_t hole = page_index_slot(index, pages[entry]);
+    while (index->slots[hole] != entry) {
+        hole = (hole + 1) & mask;
+    }
+    for (uint64_t next = (hole + 1) & mask; index->slots[next] != UNMAPPED; next = (next + 1) & mask) {
+        uint64_t home = page_index_slot(index, pages[index->slots[next]]);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            index->slots[hole] = index->slots[next];
+            hole = next;
+        }
+    }
+    index->slots[hole] = UNMAPPED;
+}
+
+/**
+ * STRUCT: LirsPolicy
+ * LIRS (low inter-reference recency set). Pages are LIR (hot, never
+ * evicted while LIR) or HIR; 1% of the frames hold resident HIR pages
+ * in queue Q, whose front is the victim. Stack S orders pages by
+ * recency and keeps an LIR page at its bottom; a HIR page re-accessed
+ * while still in S has a shorter reuse distance than the bottom LIR page
+ * and swaps status with it. Evicted HIR pages stay in S as non-resident
+ * entries, at most LIRS_NONRESIDENT_RATIO per frame, the oldest being
+ * dropped first. Entries are found by page through a PageIndex.
+ * */
+enum LirsFlag {
+    LIRS_LIR = 1,
+    LIRS_IN_STACK = 2
+} typedef LirsFlag;
+
+struct LirsPolicy {
+    int lir_count;
+    int lir_capacity;
+    int nonresident_count;
+    int nonresident_limit;
+    int nonresident_peak;
+    int free_entry;
+    uint64_t* pages;
+    int* frames;
+    unsigned char* flags;
+    int* frame_entries;
+    FrameList stack;
+    FrameList queue;
+    FrameList nonresident;
+    PageIndex index;
+} typedef LirsPolicy;
+
+/// Bytes of metadata per LIRS entry, including its two hash slots.
+#define LIRS_ENTRY_BYTES (sizeof(uint64_t) + sizeof(int) * 7 + sizeof(unsigned char))
+
+static int new_lirs_entry(LirsPolicy* lirs, uint64_t page_number) {
+    int entry = lirs->free_entry;
+    lirs->free_entry = lirs->queue.next[entry];
+    lirs->pages[entry] = page_number;
+    lirs->flags[entry] = 0;
+    insert_page_index(&lirs->index, lirs->pages, entry);
+    return entry;
+}
+
+static void delete_lirs_entry(LirsPolicy* lirs, int entry) {
+    remove_page_index(&lirs->index, lirs->pages, entry);
+    lirs->queue.next[entry] = lirs->free_entry;
+    lirs->free_entry = entry;
+}
+
+/// Pops HIR entries off the bottom of S until an LIR entry is there, forgetting non-resident ones.
+static void prune_lirs_stack(LirsPolicy* lirs) {
+    while (lirs->stack.tail != UNMAPPED && !(lirs->flags[lirs->stack.tail] & LIRS_LIR)) {
+        int entry = lirs->stack.tail;
+        remove_frame_list(&lirs->stack, entry);
+        lirs->flags[entry] &= ~LIRS_IN_STACK;
+        if (lirs->frames[entry] == UNMAPPED) {
+            remove_frame_list(&lirs->nonresident, entry);
+            lirs->nonresident_count--;
+            delete_lirs_entry(lirs, entry);
+        }
+    }
+}
+
+/// Turns the bottom LIR page of S into a resident HIR page if there are too many LIR pages.
+static void balance_lirs(LirsPolicy* lirs) {
+    if (lirs->lir_count <= lirs->lir_capacity) {
+        return;
+    }
+
+    /// S only lacks an LIR page at its bottom when there were none to begin with.
+    prune_lirs_stack(lirs);
+    int entry = lirs->stack.tail;
+    remove_frame_list(&lirs->stack, entry);
+    lirs->flags[entry] &= ~(LIRS_LIR | LIRS_IN_STACK);
+    lirs->lir_count--;
+    push_frame_list(&lirs->queue, entry);
+    prune_lirs_stack(lirs);
+}
+
+static void lirs_access(void* state, int frame_number, uint64_t page_number) {
+    LirsPolicy* lirs = (LirsPolicy*)state;
+    int entry = lirs->frame_entries[frame_number];
+    (void)page_number;
+
+    if (lirs->flags[entry] & LIRS_LIR) {
+        int was_bottom = lirs->stack.tail == entry;
+        remove_frame_list(&lirs->stack, entry);
+        push_frame_list(&lirs->stack, entry);
+        if (was_bottom) {
+            prune_lirs_stack(lirs);
+        }
+    } else if (lirs->flags[entry] & LIRS_IN_STACK) {
+        /// A resident HIR page hit while still in S becomes LIR.
+        remove_frame_list(&lirs->stack, entry);
+        push_frame_list(&lirs->stack, entry);
+        remove_frame_list(&lirs->queue, entry);
+        lirs->flags[entry] |= LIRS_LIR;
+        lirs->lir_count++;
+        balance_lirs(lirs);
+    } else {
+        push_frame_list(&lirs->stack, entry);
+        lirs->flags[entry] |= LIRS_IN_STACK;
+        remove_frame_list(&lirs->queue, entry);
+        push_frame_list(&lirs->queue, entry);
+    }
+}
+
+static void lirs_install(void* state, int frame_number, uint64_t page_number) {
+    LirsPolicy* lirs = (LirsPolicy*)state;
+    int entry = find_page_index(&lirs->index, lirs->pages, page_number);
+
+    if (entry != UNMAPPED) {
+        /// A non-resident HIR page faulting while still in S comes back as LIR.
+        remove_frame_list(&lirs->nonresident, entry);
+        lirs->nonresident_count--;
+        remove_frame_list(&lirs->stack, entry);
+        push_frame_list(&lirs->stack, entry);
+        lirs->flags[entry] |= LIRS_LIR;
+        lirs->lir_count++;
+        lirs->frames[entry] = frame_number;
+        lirs->frame_entries[frame_number] = entry;
+        balance_lirs(lirs);
+        return;
+    }
+
+    entry = new_lirs_entry(lirs, page_number);
+    lirs->frames[entry] = frame_number;
+    lirs->frame_entries[frame_number] = entry;
+    push_frame_list(&lirs->stack, entry);
+    if (lirs->lir_count < lirs->lir_capacity) {
+        lirs->flags[entry] = LIRS_LIR | LIRS_IN_STACK;
+        lirs->lir_count++;
+    } else {
+        lirs->flags[entry] = LIRS_IN_STACK;
+        push_frame_list(&lirs->queue, entry);
+    }
+}
+
+static int lirs_victim(void* state) {
+    LirsPolicy* lirs = (LirsPolicy*)state;
+    int entry = lirs->queue.tail;
+    int frame_number = lirs->frames[entry];
+    remove_frame_list(&lirs->queue, entry);
+    lirs->frames[entry] = UNMAPPED;
+
+    if (!(lirs->flags[entry] & LIRS_IN_STACK)) {
+        delete_lirs_entry(lirs, entry);
+        return frame_number;
+    }
+
+    /// Keep the evicted page in S as non-resident, dropping the oldest such page past the limit.
+    push_frame_list(&lirs->nonresident, entry);
+    lirs->nonresident_count++;
+    if (lirs->nonresident_count > lirs->nonresident_limit) {
+        int oldest = lirs->nonresident.tail;
+        remove_frame_list(&lirs->nonresident, oldest);
+        remove_frame_list(&lirs->stack, oldest);
+        lirs->nonresident_count--;
+        delete_lirs_entry(lirs, oldest);
+    }
+    if (lirs->nonresident_count > lirs->nonresident_peak) {
+        lirs->nonresident_peak = lirs->nonresident_count;
+    }
+    return frame_number;
+}
+
+static void lirs_report(void* state, FILE* stream) {
+    LirsPolicy* lirs = (LirsPolicy*)state;
+    int resident_count = lirs->lir_count + lirs->queue.size;
+    fprintf(stream, "LIRS: %d LIR and %d HIR resident pages, %zu bytes of resident metadata\n",
+            lirs->lir_count, lirs->queue.size, (size_t)resident_count * LIRS_ENTRY_BYTES);
+    fprintf(stream, "LIRS: %d non-resident pages (peak %d, limit %d), %zu bytes of non-resident metadata (peak %zu)\n",
+            lirs->nonresident_count, lirs->nonresident_peak, lirs->nonresident_limit,
+            (size_t)lirs->nonresident_count * LIRS_ENTRY_BYTES, (size_t)lirs->nonresident_peak * LIRS_ENTRY_BYTES);
+}
+
+/**
+ * FUNCTION: create_lirs_policy()
+ * Creates a LIRS replacement policy.
+ * */
+ReplacementPolicy* create_lirs_policy(int frame_count) {
+    LirsPolicy* lirs = (LirsPolicy*)calloc(1, sizeof(LirsPolicy));
+    int hir_capacity = frame_count * LIRS_HIR_PERCENT / 100 > 0 ? frame_count * LIRS_HIR_PERCENT / 100 : 1;
+    lirs->lir_capacity = frame_count > hir_capacity ? frame_count - hir_capacity : 0;
+    lirs->nonresident_limit = frame_count * LIRS_NONRESIDENT_RATIO;
+
+    /// One entry per frame and per non-resident page, plus one for the page being dropped.
+    int entry_count = frame_count + lirs->nonresident_limit + 1;
+    lirs->pages = (uint64_t*)calloc(entry_count, sizeof(uint64_t));
+    lirs->frames = (int*)malloc(sizeof(int) * entry_count);
+    lirs->flags = (unsigned char*)calloc(entry_count, sizeof(unsigned char));
+    lirs->frame_entries = (int*)malloc(sizeof(int) * frame_count);
+    int* queue_next = (int*)malloc(sizeof(int) * entry_count);
+    int* queue_prev = (int*)malloc(sizeof(int) * entry_count);
+    init_frame_list(&lirs->stack, (int*)malloc(sizeof(int) * entry_count), (int*)malloc(sizeof(int) * entry_count));
+    init_frame_list(&lirs->queue, queue_prev, queue_next);
+    init_frame_list(&lirs->nonresident, queue_prev, queue_next);
+    init_page_index(&lirs->index, entry_count);
+
+    /// Free entries are chained through the queue links.
+    for (int i = 0; i < entry_count; i++) {
+        queue_next[i] = i + 1 < entry_count ? i + 1 : UNMAPPED;
+    }
+    lirs->free_entry = 0;
+
+    ReplacementPolicy* new_policy = (ReplacementPolicy*)calloc(1, sizeof(ReplacementPolicy));
+    new_policy->state = lirs;
+    new_policy->access = lirs_access;
+    new_policy->install = lirs_install;
+    new_policy->victim = lirs_victim;
+    new_policy->report = lirs_report;
+    return new_policy;
+}
+
+/**
+ * STRUCT: ClockProPolicy
+ * CLOCK-Pro, the clock approximation of LIRS. Resident hot and cold
+ * pages and non-resident cold pages share one circular list, swept by
+ * hand_hot, which demotes unreferenced hot pages once hot pages exceed
+ * frame_count - cold_target, and by hand_test, which drops non-resident
+ * pages beyond one per frame. Both end the test periods of the cold
+ * pages they pass. A hit only sets a reference bit. hand_cold evicts
+ * unreferenced cold pages, promoting cold pages referenced during their
+ * test period; it sweeps a second ring holding only the resident cold
+ * pages, so it never has to step over hot pages when cold_target is
+ * small. cold_target grows when a non-resident page faults during its
+ * test period and shrinks when a test period ends without one.
+ * */
+enum ClockProFlag {
+    CLOCKPRO_HOT = 1,
+    CLOCKPRO_REFERENCED = 2,
+    CLOCKPRO_TEST = 4
+} typedef ClockProFlag;
+
+struct ClockProPolicy {
+    int frame_count;
+    int cold_target;
+    int hot_count;
+    int nonresident_count;
+    int nonresident_peak;
+    int free_entry;
+    int hand_hot;
+    int hand_test;
+    int hand_cold;
+    uint64_t* pages;
+    int* frames;
+    unsigned char* flags;
+    int* prev;
+    int* next;
+    int* cold_prev;
+    int* cold_next;
+    int* frame_entries;
+    PageIndex index;
+} typedef ClockProPolicy;
+
+/// Bytes of metadata per CLOCK-Pro entry, including its two hash slots.
+#define CLOCKPRO_ENTRY_BYTES (sizeof(uint64_t) + sizeof(int) * 7 + sizeof(unsigned char))
+
+/// Inserts an entry at the head of the list, just behind hand_hot.
+static void insert_clockpro_entry(ClockProPolicy* clockpro, int entry) {
+    if (clockpro->hand_hot == UNMAPPED) {
+        clockpro->prev[entry] = entry;
+        clockpro->next[entry] = entry;
+        clockpro->hand_hot = entry;
+        clockpro->hand_test = entry;
+        return;
+    }
+    int after = clockpro->hand_hot;
+    int before = clockpro->prev[after];
+    clockpro->prev[entry] = before;
+    clockpro->next[entry] = after;
+    clockpro->next[before] = entry;
+    clockpro->prev[after] = entry;
+}
+
+/// Unlinks an entry from the list, moving any hand on it to the next entry.
+static void unlink_clockpro_entry(ClockProPolicy* clockpro, int entry) {
+    int next = clockpro->next[entry];
+    if (next == entry) {
+        next = UNMAPPED;
+    } else {
+        clockpro->next[clockpro->prev[entry]] = next;
+        clockpro->prev[next] = clockpro->prev[entry];
+    }
+    clockpro->hand_hot = clockpro->hand_hot == entry ? next : clockpro->hand_hot;
+    clockpro->hand_test = clockpro->hand_test == entry ? next : clockpro->hand_test;
+}
+
+/// Adds a resident cold page to the cold ring, just behind hand_cold.
+static void insert_clockpro_cold(ClockProPolicy* clockpro, int entry) {
+    if (clockpro->hand_cold == UNMAPPED) {
+        clockpro->cold_prev[entry] = entry;
+        clockpro->cold_next[entry] = entry;
+        clockpro->hand_cold = entry;
+        return;
+    }
+    int after = clockpro->hand_cold;
+    int before = clockpro->cold_prev[after];
+    clockpro->cold_prev[entry] = before;
+    clockpro->cold_next[entry] = after;
+    clockpro->cold_next[before] = entry;
+    clockpro->cold_prev[after] = entry;
+}
+
+static void unlink_clockpro_cold(ClockProPolicy* clockpro, int entry) {
+    int next = clockpro->cold_next[entry];
+    if (next == entry) {
+        next = UNMAPPED;
+    } else {
+        clockpro->cold_next[clockpro->cold_prev[entry]] = next;
+        clockpro->cold_prev[next] = clockpro->cold_prev[entry];
+    }
+    clockpro->hand_cold = clockpro->hand_cold == entry ? next : clockpro->hand_cold;
+}
+
+static void delete_clockpro_entry(ClockProPolicy* clockpro, int entry) {
+    unlink_clockpro_entry(clockpro, entry);
+    remove_page_index(&clockpro->index, clockpro->pages, entry);
+    clockpro->next[entry] = clockpro->free_entry;
+    clockpro->free_entry = entry;
+}
+
+/// Ends a cold page's test period without a re-access.
+static void end_clockpro_test(ClockProPolicy* clockpro, int entry) {
+    if (clockpro->cold_target > 1) {
+        clockpro->cold_target--;
+    }
+    if (clockpro->frames[entry] == UNMAPPED) {
+        delete_clockpro_entry(clockpro, entry);
+        clockpro->nonresident_count--;
+    } else {
+        clockpro->flags[entry] &= ~CLOCKPRO_TEST;
+    }
+}
+
+/// Sweeps hand_hot until hot pages fit in frame_count - cold_target.
+static void run_clockpro_hand_hot(ClockProPolicy* clockpro) {
+    while (clockpro->hot_count > clockpro->frame_count - clockpro->cold_target) {
+        int entry = clockpro->hand_hot;
+        clockpro->hand_hot = clockpro->next[entry];
+        if (clockpro->flags[entry] & CLOCKPRO_HOT) {
+            if (clockpro->flags[entry] & CLOCKPRO_REFERENCED) {
+                clockpro->flags[entry] &= ~CLOCKPRO_REFERENCED;
+            } else {
+                clockpro->flags[entry] = 0;
+                clockpro->hot_count--;
+                insert_clockpro_cold(clockpro, entry);
+            }
+        } else if (clockpro->flags[entry] & CLOCKPRO_TEST) {
+            end_clockpro_test(clockpro, entry);
+        }
+    }
+}
+
+/// Sweeps hand_test until non-resident pages are back within one per frame.
+static void run_clockpro_hand_test(ClockProPolicy* clockpro) {
+    while (clockpro->nonresident_count > clockpro->frame_count) {
+        int entry = clockpro->hand_test;
+        clockpro->hand_test = clockpro->next[entry];
+        if (!(clockpro->flags[entry] & CLOCKPRO_HOT) && (clockpro->flags[entry] & CLOCKPRO_TEST)) {
+            end_clockpro_test(clockpro, entry);
+        }
+    }
+}
+
+static void clockpro_access(void* state, int frame_number, uint64_t page_number) {
+    ClockProPolicy* clockpro = (ClockProPolicy*)state;
+    (void)page_number;
+    clockpro->flags[clockpro->frame_entries[frame_number]] |= CLOCKPRO_REFERENCED;
+}
+
+static void clockpro_install(void* state, int frame_number, uint64_t page_number) {
+    ClockProPolicy* clockpro = (ClockProPolicy*)state;
+    int entry = find_page_index(&clockpro->index, clockpro->pages, page_number);
+
+    if (entry != UNMAPPED) {
+        /// A non-resident page faulting during its test period: cold pages deserve more room.
+        if (clockpro->cold_target < clockpro->frame_count - 1) {
+            clockpro->cold_target++;
+        }
+        unlink_clockpro_entry(clockpro, entry);
+        clockpro->nonresident_count--;
+        clockpro->flags[entry] = CLOCKPRO_HOT;
+        clockpro->hot_count++;
+    } else {
+        entry = clockpro->free_entry;
+        clockpro->free_entry = clockpro->next[entry];
+        clockpro->pages[entry] = page_number;
+        clockpro->flags[entry] = CLOCKPRO_TEST;
+        insert_page_index(&clockpro->index, clockpro->pages, entry);
+        insert_clockpro_cold(clockpro, entry);
+    }
+    clockpro->frames[entry] = frame_number;
+    clockpro->frame_entries[frame_number] = entry;
+    insert_clockpro_entry(clockpro, entry);
+    run_clockpro_hand_hot(clockpro);
+}
+
+static int clockpro_victim(void* state) {
+    ClockProPolicy* clockpro = (ClockProPolicy*)state;
+    for (;;) {
+        int entry = clockpro->hand_cold;
+        unsigned char flags = clockpro->flags[entry];
+
+        /// A referenced cold page is promoted if in its test period, or starts a new one, at the list head.
+        if (flags & CLOCKPRO_REFERENCED) {
+            unlink_clockpro_entry(clockpro, entry);
+            insert_clockpro_entry(clockpro, entry);
+            if (flags & CLOCKPRO_TEST) {
+                unlink_clockpro_cold(clockpro, entry);
+                clockpro->flags[entry] = CLOCKPRO_HOT;
+                clockpro->hot_count++;
+                run_clockpro_hand_hot(clockpro);
+            } else {
+                clockpro->flags[entry] = CLOCKPRO_TEST;
+                clockpro->hand_cold = clockpro->cold_next[entry];
+            }
+            continue;
+        }
+
+        /// An unreferenced cold page is evicted, staying on as non-resident if in its test period.
+        int frame_number = clockpro->frames[entry];
+        clockpro->frames[entry] = UNMAPPED;
+        unlink_clockpro_cold(clockpro, entry);
+        if (flags & CLOCKPRO_TEST) {
+            clockpro->nonresident_count++;
+            if (clockpro->nonresident_count > clockpro->nonresident_peak) {
+                clockpro->nonresident_peak = clockpro->nonresident_count;
+            }
+            run_clockpro_hand_test(clockpro);
+        } else {
+            delete_clockpro_entry(clockpro, entry);
+        }
+        return frame_number;
+    }
+}
+
+static void clockpro_report(void* state, FILE* stream) {
+    ClockProPolicy* clockpro = (ClockProPolicy*)state;
+    fprintf(stream, "CLOCK-Pro: %d hot pages, cold target %d, %zu bytes of resident metadata\n",
+            clockpro->hot_count, clockpro->cold_target, (size_t)clockpro->frame_count * CLOCKPRO_ENTRY_BYTES);
+    fprintf(stream, "CLOCK-Pro: %d non-resident pages (peak %d, limit %d), %zu bytes of non-resident metadata (peak %zu)\n",
+            clockpro->nonresident_count, clockpro->nonresident_peak, clockpro->frame_count,
+            (size_t)clockpro->nonresident_count * CLOCKPRO_ENTRY_BYTES, (size_t)clockpro->nonresident_peak * CLOCKPRO_ENTRY_BYTES);
+}
+
+/**
+ * FUNCTION: create_clockpro_policy()
+ * Creates a CLOCK-Pro replacement policy.
+ * */
+ReplacementPolicy* create_clockpro_policy(int frame_count) {
+    ClockProPolicy* clockpro = (ClockProPolicy*)calloc(1, sizeof(ClockProPolicy));
+    clockpro->frame_count = frame_count;
+    clockpro->cold_target = frame_count / 100 > 0 ? frame_count / 100 : 1;
+    clockpro->hand_hot = UNMAPPED;
+    clockpro->hand_test = UNMAPPED;
+    clockpro->hand_cold = UNMAPPED;
+
+    /// One entry per frame and per non-resident page, plus one for the page being dropped.
+    int entry_count = 2 * frame_count + 1;
+    clockpro->pages = (uint64_t*)calloc(entry_count, sizeof(uint64_t));
+    clockpro->frames = (int*)malloc(sizeof(int) * entry_count);
+    clockpro->flags = (unsigned char*)calloc(entry_count, sizeof(unsigned char));
+    clockpro->prev = (int*)malloc(sizeof(int) * entry_count);
+    clockpro->next = (int*)malloc(sizeof(int) * entry_count);
+    clockpro->cold_prev = (int*)malloc(sizeof(int) * entry_count);
+    clockpro->cold_next = (int*)malloc(sizeof(int) * entry_count);
+    clockpro->frame_entries = (int*)malloc(sizeof(int) * frame_count);
+    init_page_index(&clockpro->index, entry_count);
+
+    /// Free entries are chained through the next links.
+    for (int i = 0; i < entry_count; i++) {
+        clockpro->next[i] = i + 1 < entry_count ? i + 1 : UNMAPPED;
+    }
+    clockpro->free_entry = 0;
+
+    ReplacementPolicy* new_policy = (ReplacementPolicy*)calloc(1, sizeof(ReplacementPolicy));
+    new_policy->state = clockpro;
+    new_policy->access = clockpro_access;
+    new_policy->install = clockpro_install;
+    new_policy->victim = clockpro_victim;
+    new_policy->report = clockpro_report;
+    return new_policy;
+}
+
+/**
+ * STRUCT: LfuPolicy
+ * Least frequently used, in O(1) per operation. Frames are grouped in
+ * buckets by key, the buckets form a list in increasing key order, and
+ * each bucket lists its frames most recent first, so a hit moves its
+ * frame to the neighbouring bucket and the victim is the least recent
+ * frame of the first bucket. For plain LFU the key is the access count.
+ * With dynamic aging (LFU-DA) the policy remembers the key of the last
+ * victim as the cache age, and a new page starts at age + 1 rather than
+ * 1, so pages that were hot long ago are eventually overtaken by newer
+ * pages and evicted. A hit adds one to the key in both cases.
+ * */
+struct LfuPolicy {
+    int dynamic_aging;
+    uint64_t age;
+    int bucket_head;
+    int free_bucket;
+    int* frame_buckets;
+    uint64_t* bucket_keys;
+    int* bucket_prev;
+    int* bucket_next;
+    FrameList* bucket_frames;
+} typedef LfuPolicy;
+
+/// Returns the bucket with the given key, creating it after bucket after (or first, if UNMAPPED).
+static int lfu_bucket(LfuPolicy* lfu, int after, uint64_t key) {
+    int next = after == UNMAPPED ? lfu->bucket_head : lfu->bucket_next[after];
+    if (next != UNMAPPED && lfu->bucket_keys[next] == key) {
+        return next;
+    }
+    int bucket = lfu->free_bucket;
+    lfu->free_bucket = lfu->bucket_next[bucket];
+    lfu->bucket_keys[bucket] = key;
+    lfu->bucket_frames[bucket].head = UNMAPPED;
+    lfu->bucket_frames[bucket].tail = UNMAPPED;
+    lfu->bucket_frames[bucket].size = 0;
+    lfu->bucket_prev[bucket] = after;
+    lfu->bucket_next[bucket] = next;
+    if (next != UNMAPPED) {
+        lfu->bucket_prev[next] = bucket;
+    }
+    if (after != UNMAPPED) {
+        lfu->bucket_next[after] = bucket;
+    } else {
+        lfu->bucket_head = bucket;
+    }
+    return bucket;
+}
+
+/// Takes a frame out of its bucket, freeing the bucket if that empties it.
+static void lfu_unlink(LfuPolicy* lfu, int frame_number) {
+    int bucket = lfu->frame_buckets[frame_number];
+    remove_frame_list(&lfu->bucket_frames[bucket], frame_number);
+    if (lfu->bucket_frames[bucket].size > 0) {
+        return;
+    }
+    int prev = lfu->bucket_prev[bucket];
+    int next = lfu->bucket_next[bucket];
+    if (prev != UNMAPPED) {
+        lfu->bucket_next[prev] = next;
+    } else {
+        lfu->bucket_head = next;
+    }
+    if (next != UNMAPPED) {
+        lfu->bucket_prev[next] = prev;
+    }
+    lfu->bucket_next[bucket] = lfu->free_bucket;
+    lfu->free_bucket = bucket;
+}
+
+static void lfu_access(void* state, int frame_number, uint64_t page_number) {
+    LfuPolicy* lfu = (LfuPolicy*)state;
+    int bucket = lfu->frame_buckets[frame_number];
+    (void)page_number;
+
+    /// The frame moves to the bucket one key higher, created next to its current one if needed.
+    /// The current bucket is only unlinked afterwards, so it can still serve as the position.
+    int target = lfu_bucket(lfu, bucket, lfu->bucket_keys[bucket] + 1);
+    lfu_unlink(lfu, frame_number);
+    push_frame_list(&lfu->bucket_frames[target], frame_number);
+    lfu->frame_buckets[frame_number] = target;
+}
+
+static void lfu_install(void* state, int frame_number, uint64_t page_number) {
+    LfuPolicy* lfu = (LfuPolicy*)state;
+    uint64_t key = lfu->age + 1;
+    (void)page_number;
+
+    /// Every key is at least the age, so the new page's bucket is first or second.
+    int after = UNMAPPED;
+    if (lfu->bucket_head != UNMAPPED && lfu->bucket_keys[lfu->bucket_head] < key) {
+        after = lfu->bucket_head;
+    }
+    int bucket = lfu_bucket(lfu, after, key);
+    push_frame_list(&lfu->bucket_frames[bucket], frame_number);
+    lfu->frame_buckets[frame_number] = bucket;
+}
+
+static int lfu_victim(void* state) {
+    LfuPolicy* lfu = (LfuPolicy*)state;
+    int bucket = lfu->bucket_head;
+    int frame_number = lfu->bucket_frames[bucket].tail;
+    if (lfu->dynamic_aging) {
+        lfu->age = lfu->bucket_keys[bucket];
+    }
+    lfu_unlink(lfu, frame_number);
+    return frame_number;
+}
+
+static ReplacementPolicy* create_lfu_variant(int frame_count, int dynamic_aging) {
+    LfuPolicy* lfu = (LfuPolicy*)calloc(1, sizeof(LfuPolicy));
+    int* prev = (int*)malloc(sizeof(int) * frame_count);
+    int* next = (int*)malloc(sizeof(int) * frame_count);
+    lfu->dynamic_aging = dynamic_aging;
+    lfu->frame_buckets = (int*)malloc(sizeof(int) * frame_count);
+
+    /// Every bucket in the list holds a frame, plus one for the bucket being created.
+    int bucket_count = frame_count + 1;
+    lfu->bucket_keys = (uint64_t*)calloc(bucket_count, sizeof(uint64_t));
+    lfu->bucket_prev = (int*)malloc(sizeof(int) * bucket_count);
+    lfu->bucket_next = (int*)malloc(sizeof(int) * bucket_count);
+    lfu->bucket_frames = (FrameList*)calloc(bucket_count, sizeof(FrameList));
+    for (int i = 0; i < bucket_count; i++) {
+        init_frame_list(&lfu->bucket_frames[i], prev, next);
+        lfu->bucket_next[i] = i + 1 < bucket_count ? i + 1 : UNMAPPED;
+    }
+    lfu->bucket_head = UNMAPPED;
+    lfu->free_bucket = 0;
+
+    ReplacementPolicy* new_policy = (ReplacementPolicy*)calloc(1, sizeof(ReplacementPolicy));
+    new_policy->state = lfu;
+    new_policy->access = lfu_access;
+    new_policy->install = lfu_install;
+    new_policy->victim = lfu_victim;
+    return new_policy;
+}
+
+/**
+ * FUNCTION: create_lfu_policy()
+ * Creates a least frequently used replacement policy.
+ * */
+ReplacementPolicy* create_lfu_policy(int frame_count) {
+    return create_lfu_variant(frame_count, 0);
+}
+
+/**
+ * FUNCTION: create_lfuda_policy()
+ * Creates a least frequently used replacement policy with dynamic aging.
+ * */
+ReplacementPolicy* create_lfuda_policy(int frame_count) {
+    return create_lfu_variant(frame_count, 1);
+}
+
+/**
+ * STRUCT: BenchContext
+ * The inputs shared by the microbenchmark kernels: a stream of random
+ * page numbers, a pre-formatted text trace, a memory to translate in,
+ * and a sink for formatted output.
+ * */
+struct BenchContext {
+    uint64_t ops;
+    uint64_t* pages;
+    uint64_t page_count;
+    int frame_count;
+    char* trace_text;
+    size_t trace_text_size;
+    PhysicalMemory* physical_memory;
+    PageTable* page_table;
+    BackingStore* backing_store;
+    ReplacementPolicy* policy;
+    FILE* sink;
+    uint64_t cursor;
+    volatile int64_t checksum;
+} typedef BenchContext;
+
+/**
+ * The kernels below each perform context->ops operations of one kind.
+ * */
+static void bench_parse(BenchContext* context) {
+    FILE* file_input = fmemopen(context->trace_text, context->trace_text_size, "r");
+    VirtualMemory* virtual_memory = create_virtual_memory(file_input);
+    context->checksum += virtual_memory->address_count;
+    fclose(file_input);
+    free(virtual_memory->addresses);
+    free(virtual_memory);
+}
+
+static void bench_lookup(BenchContext* context) {
+    int64_t sum = 0;
+    for (uint64_t i = 0; i < context->ops; i++) {
+        sum += context->page_table->map[context->pages[i]];
+    }
+    context->checksum += sum;
+}
+
+static void bench_fault(BenchContext* context) {
+    /// A cyclic scan over more pages than frames faults on every reference under FIFO.
+    for (uint64_t i = 0; i < context->ops; i++) {
+        uint64_t page_number = context->cursor;
+        context->cursor = (context->cursor + 1) % context->page_count;
+        if (context->page_table->map[page_number] == UNMAPPED) {
+            context->checksum += service_page_fault(context->physical_memory, context->page_table, context->backing_store, page_number);
+        }
+    }
+}
+
+static void bench_format(BenchContext* context) {
+    for (uint64_t i = 0; i < context->ops; i++) {
+        uint64_t page_number = context->pages[i];
+        fprintf(context->sink, TRANSLATION_FORMAT, (page_number << PAGE_NUMBER_OFFSET_BITS) | (i & PAGE_OFFSET_MASK),
+                ((page_number % context->frame_count) << FRAME_NUMBER_OFFSET_BITS) | (i & PAGE_OFFSET_MASK), (int)(signed char)i);
+    }
+}
+
+static void bench_policy_access(BenchContext* context) {
+    /// Frame n was filled with page n, so each access hits a resident page.
+    ReplacementPolicy* policy = context->policy;
+    for (uint64_t i = 0; i < context->ops; i++) {
+        int frame_number = (int)(context->pages[i] % context->frame_count);
+        policy->access(policy->state, frame_number, (uint64_t)frame_number);
+    }
+}
+
+static void bench_policy_victim(BenchContext* context) {
+    /// Replacement pages are numbered past every page loaded before, so they are never resident.
+    ReplacementPolicy* policy = context->policy;
+    for (uint64_t i = 0; i < context->ops; i++) {
+        int frame_number = policy->victim(policy->state);
+        policy->install(policy->state, frame_number, context->cursor++);
+        context->checksum += frame_number;
+    }
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double elapsed_nanoseconds(struct timespec* start, struct timespec* end) {
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 + (double)(end->tv_nsec - start->tv_nsec);
+}
+
+/**
+ * FUNCTION: run_benchmark_kernel()
+ * Runs a kernel for the warmup rounds, then times each repetition and
+ * reports the median and 99th percentile cost per operation, as text on
+ * stdout and, if json_file is set, as one entry of a JSON array.
+ * */
+static void run_benchmark_kernel(const char* name, void (*kernel)(BenchContext*), BenchContext* context,
+                                 int warmup, int repetitions, FILE* json_file, int* json_entries) {
+    double* samples = (double*)malloc(sizeof(double) * repetitions);
+
+    for (int i = 0; i < warmup; i++) {
+        kernel(context);
+    }
+    for (int i = 0; i < repetitions; i++) {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        kernel(context);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        samples[i] = elapsed_nanoseconds(&start, &end) / (double)context->ops;
+    }
+
+    qsort(samples, repetitions, sizeof(double), compare_doubles);
+    double median = samples[repetitions / 2];
+    double p99 = samples[(int)ceil(0.99 * repetitions) - 1];
+    double ops_per_second = median > 0.0 ? 1e9 / median : 0.0;
+
+    printf("%-28s %10.2f ns/op %10.2f ns/op p99 %16.0f ops/s\n", name, median, p99, ops_per_second);
+    if (json_file != NULL) {
+        fprintf(json_file, "%s\n    {\"name\": \"%s\", \"ops\": %" PRIu64 ", \"repetitions\": %d, "
+                "\"ns_per_op_median\": %.3f, \"ns_per_op_p99\": %.3f, \"ops_per_second\": %.0f}",
+                (*json_entries)++ > 0 ? "," : "", name, context->ops, repetitions, median, p99, ops_per_second);
+    }
+    free(samples);
+}
+
+/**
+ * FUNCTION: run_benchmarks()
+ * Times the translation hot paths one kernel at a time: parsing a text
+ * trace, page table hits, the page fault service path, output formatting,
+ * and the access and victim operations of every replacement policy.
+ * --filter restricts the run to kernels whose name contains the text.
+ * */
+int run_benchmarks(int argc, char* argv[]) {
+    uint64_t ops = BENCH_DEFAULT_OPS;
+    uint64_t repetitions = BENCH_DEFAULT_REPETITIONS;
+    uint64_t warmup = BENCH_DEFAULT_WARMUP;
+    uint64_t frame_count = 128;
+    uint64_t page_count = PAGE_TABLE_SIZE;
+    const char* backing_store_path = "BACKING_STORE.bin";
+    const char* json_path = NULL;
+    const char* filter = "";
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        int ok = value != NULL;
+        if (ok && strcmp(argv[i], "--ops") == 0) {
+            ok = parse_count(value, &ops) && ops > 0;
+        } else if (ok && strcmp(argv[i], "--repetitions") == 0) {
+            ok = parse_count(value, &repetitions) && repetitions > 0 && repetitions <= INT32_MAX;
+        } else if (ok && strcmp(argv[i], "--warmup") == 0) {
+            ok = parse_count(value, &warmup) && warmup <= INT32_MAX;
+        } else if (ok && strcmp(argv[i], "--frames") == 0) {
+            ok = parse_count(value, &frame_count) && frame_count > 0 && frame_count <= INT32_MAX;
+        } else if (ok && strcmp(argv[i], "--pages") == 0) {
+            ok = parse_count(value, &page_count) && page_count > 0;
+        } else if (ok && strcmp(argv[i], "--backing-store") == 0) {
+            backing_store_path = value;
+        } else if (ok && strcmp(argv[i], "--json") == 0) {
+            json_path = value;
+        } else if (ok && strcmp(argv[i], "--filter") == 0) {
+            filter = value;
+        } else {
+            printf("Usage: bench [--ops N] [--repetitions N] [--warmup N] [--frames N] [--pages N]\n");
+            printf("             [--backing-store file] [--json file] [--filter text]\n");
+            return -1;
+        }
+        i++;
+    }
+    if (page_count <= frame_count) {
+        printf("Error: --pages must be larger than --frames so that the fault path evicts\n");
+        return -1;
+    }
+
+    /// Prepare the shared inputs: random pages, and the same pages as a text trace.
+    BenchContext context;
+    memset(&context, 0, sizeof(context));
+    context.ops = ops;
+    context.page_count = page_count;
+    context.frame_count = (int)frame_count;
+    context.pages = (uint64_t*)malloc(sizeof(uint64_t) * ops);
+    context.trace_text = (char*)malloc(24 * ops + 1);
+
+    Random random;
+    seed_random(&random, TRACE_DEFAULT_SEED);
+    for (uint64_t i = 0; i < ops; i++) {
+        context.pages[i] = next_random_below(&random, page_count);
+        context.trace_text_size += (size_t)sprintf(context.trace_text + context.trace_text_size, "%" PRIu64 "\n",
+                                                   (context.pages[i] << PAGE_NUMBER_OFFSET_BITS) | next_random_below(&random, PAGE_SIZE));
+    }
+
+    context.backing_store = create_backing_store(backing_store_path, 0);
+    context.sink = fopen("/dev/null", "w");
+    context.physical_memory = create_physical_memory((int)frame_count);
+    context.page_table = create_page_table(page_count);
+    if (context.backing_store == NULL || context.sink == NULL || context.physical_memory == NULL || context.page_table == NULL) {
+        printf("Error: unable to set up the benchmark (backing store '%s')\n", backing_store_path);
+        return -2;
+    }
+    context.physical_memory->policy = create_fifo_policy((int)frame_count);
+
+    FILE* json_file = NULL;
+    int json_entries = 0;
+    if (json_path != NULL) {
+        json_file = fopen(json_path, "w");
+        if (json_file == NULL) {
+            printf("Error: unable to open %s\n", json_path);
+            return -2;
+        }
+        fprintf(json_file, "{\"frames\": %" PRIu64 ", \"pages\": %" PRIu64 ", \"benchmarks\": [", frame_count, page_count);
+    }
+    int w = (int)warmup;
+    int r = (int)repetitions;
+
+    if (strstr("parse", filter) != NULL) {
+        run_benchmark_kernel("parse", bench_parse, &context, w, r, json_file, &json_entries);
+    }
+    if (strstr("fault", filter) != NULL) {
+        run_benchmark_kernel("fault", bench_fault, &context, w, r, json_file, &json_entries);
+    }
+    if (strstr("lookup", filter) != NULL) {
+        /// Map every page so that each lookup is a hit.
+        for (uint64_t i = 0; i < page_count; i++) {
+            context.page_table->map[i] = (int)(i % frame_count);
+        }
+        run_benchmark_kernel("lookup", bench_lookup, &context, w, r, json_file, &json_entries);
+    }
+    if (strstr("format", filter) != NULL) {
+        run_benchmark_kernel("format", bench_format, &context, w, r, json_file, &json_entries);
+    }
+
+    /// Every replacement policy runs against full memory.
+    for (int i = 0; replacement_policies[i].name != NULL; i++) {
+        char name[64];
+        context.policy = create_replacement_policy(replacement_policies[i].name, (int)frame_count);
+        for (int frame_number = 0; frame_number < (int)frame_count; frame_number++) {
+            context.policy->install(context.policy->state, frame_number, (uint64_t)frame_number);
+        }
+
+        context.cursor = frame_count;
+
+        snprintf(name, sizeof(name), "policy/%s/access", context.policy->name);
+        if (context.policy->access != NULL && strstr(name, filter) != NULL) {
+            run_benchmark_kernel(name, bench_policy_access, &context, w, r, json_file, &json_entries);
+        }
+        snprintf(name, sizeof(name), "policy/%s/victim", context.policy->name);
+        if (strstr(name, filter) != NULL) {
+            run_benchmark_kernel(name, bench_policy_victim, &context, w, r, json_file, &json_entries);
+        }
+    }
+
+    if (json_file != NULL) {
+        fprintf(json_file, "\n]}\n");
+        fclose(json_file);
+    }
+    fclose(context.sink);
+    close_backing_store(context.backing_store);
+    return 0;
+}
+
+/**
+ * STRUCT: ThroughputSample
+ * What a throughput run reports back from its child process.
+ * */
+struct ThroughputSample {
+    int status;
+    double seconds;
+    SimulationResult result;
+} typedef ThroughputSample;
+
+/**
+ * FUNCTION: run_throughput_sample()
+ * Runs the simulator as configured by options in a child process with
+ * its stdout discarded, so that its allocations and peak RSS stay its
+ * own. Fills in sample with what the child reports and usage with its
+ * resource usage. Returns 0 if the child reported nothing.
+ * */
+static int run_throughput_sample(Options* options, ThroughputSample* sample, struct rusage* usage) {
+    int channel[2];
+    if (pipe(channel) != 0) {
+        return 0;
+    }
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        struct timespec start, end;
+        close(channel[0]);
+        if (freopen("/dev/null", "w", stdout) == NULL) {
+            _exit(1);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        sample->status = run_simulation(options, &sample->result);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        sample->seconds = elapsed_nanoseconds(&start, &end) / 1e9;
+        _exit(write(channel[1], sample, sizeof(*sample)) == sizeof(*sample) ? 0 : 1);
+    }
+    close(channel[1]);
+
+    int status = 0;
+    int received = child > 0 && read(channel[0], sample, sizeof(*sample)) == sizeof(*sample);
+    close(channel[0]);
+    if (child > 0) {
+        wait4(child, &status, 0, usage);
+    }
+    return received;
+}
+
+/**
+ * FUNCTION: run_throughput()
+ * Runs the whole pipeline (parse, translate, fault service and output)
+ * over generated traces of several sizes and reports addresses/second,
+ * faults/second and peak resident memory for each. Every run is made in
+ * a child process so that its peak RSS is its own. First the reference
+ * input is run with the default configuration and its output is checked
+ * byte for byte against the golden output, so that one command
+ * shows both speed and correctness regressions. Returns non-zero if the
+ * check fails.
+ * */
+int run_throughput(int argc, char* argv[]) {
+    const char* sizes = THROUGHPUT_DEFAULT_SIZES;
+    const char* model = "zipf";
+    const char* format = "binary";
+    const char* seed = "20180101";
+    const char* directory = ".";
+    const char* reference_path = "addresses.txt";
+    const char* golden_path = "correct.txt";
+    Options options;
+    set_default_options(&options);
+    options.frame_count = 128;
+    options.output_path = "/dev/null";
+    uint64_t number = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        int ok = value != NULL;
+        if (ok && strcmp(argv[i], "--sizes") == 0) {
+            sizes = value;
+        } else if (ok && strcmp(argv[i], "--model") == 0) {
+            model = value;
+        } else if (ok && strcmp(argv[i], "--format") == 0) {
+            format = value;
+        } else if (ok && strcmp(argv[i], "--seed") == 0) {
+            seed = value;
+        } else if (ok && strcmp(argv[i], "--dir") == 0) {
+            directory = value;
+        } else if (ok && strcmp(argv[i], "--reference") == 0) {
+            reference_path = value;
+        } else if (ok && strcmp(argv[i], "--golden") == 0) {
+            golden_path = value;
+        } else if (ok && strcmp(argv[i], "--output") == 0) {
+            options.output_path = value;
+        } else if (ok && strcmp(argv[i], "--backing-store") == 0) {
+            options.backing_store_path = value;
+        } else if (ok && strcmp(argv[i], "--policy") == 0) {
+            options.policy_name = value;
+        } else if (ok && strcmp(argv[i], "--frames") == 0 && parse_count(value, &number) && number > 0 && number <= INT32_MAX) {
+            options.frame_count = (int)number;
+        } else if (ok && strcmp(argv[i], "--address-bits") == 0 && parse_count(value, &number) &&
+                   number > PAGE_NUMBER_OFFSET_BITS && number <= MAX_ADDRESS_BITS) {
+            options.address_bits = (int)number;
+        } else if (strcmp(argv[i], "--mmap") == 0) {
+            options.use_mmap = 1;
+            continue;
+        } else {
+            printf("Usage: throughput [--sizes N,N,...] [--model name] [--format text|binary] [--seed N] [--dir path]\n");
+            printf("                  [--reference file] [--golden file] [--output file] [--backing-store file]\n");
+            printf("                  [--policy name] [--frames N] [--address-bits N] [--mmap]\n");
+            return -1;
+        }
+        i++;
+    }
+
+    /// Verify the reference run with the default configuration against the golden output.
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/vmm_throughput_golden.txt", directory);
+    Options golden_options;
+    char* golden_argv[] = { argv[0], "--backing-store", (char*)options.backing_store_path, (char*)reference_path };
+    if (!parse_options(4, golden_argv, &golden_options)) {
+        printf("Error: invalid reference input '%s' or backing store '%s'\n", reference_path, options.backing_store_path);
+        return -1;
+    }
+    golden_options.output_path = path;
+    ThroughputSample sample;
+    struct rusage usage;
+    int verified = run_throughput_sample(&golden_options, &sample, &usage) && sample.status == 0 && compare_output_files(path, golden_path);
+    printf("Golden output check (%s vs %s): %s\n", reference_path, golden_path, verified ? "PASS" : "FAIL");
+    unlink(path);
+
+    printf("%-8s %14s %14s %14s %12s %10s\n", "size", "addresses", "addresses/s", "faults/s", "faults", "peak RSS");
+
+    char* size_list = strdup(sizes);
+    for (char* size = strtok(size_list, ","); size != NULL; size = strtok(NULL, ",")) {
+        uint64_t count = 0;
+        if (!parse_count(size, &count)) {
+            printf("Error: invalid size '%s'\n", size);
+            return -1;
+        }
+
+        /// Generate the trace for this size over the configured address space.
+        char trace_path[4096];
+        char pages[32];
+        snprintf(trace_path, sizeof(trace_path), "%s/vmm_throughput_%s.trace", directory, size);
+        snprintf(pages, sizeof(pages), "%" PRIu64, (uint64_t)1 << (options.address_bits - PAGE_NUMBER_OFFSET_BITS));
+        char* generate_argv[] = { "generate", "--model", (char*)model, "--count", size, "--pages", pages,
+                                  "--format", (char*)format, "--seed", (char*)seed, "--quiet", trace_path };
+        if (generate_trace(13, generate_argv) != 0) {
+            return -2;
+        }
+        options.input_path = trace_path;
+
+        /// Run the pipeline in a child process and collect its timing and peak RSS.
+        int received = run_throughput_sample(&options, &sample, &usage);
+        unlink(trace_path);
+
+        if (!received || sample.status != 0) {
+            printf("%-8s run failed\n", size);
+            continue;
+        }
+        printf("%-8s %14" PRIu64 " %14.0f %14.0f %12" PRIu64 " %7ld MiB\n", size, sample.result.address_count,
+               (double)sample.result.address_count / sample.seconds, (double)sample.result.fault_count / sample.seconds,
+               sample.result.fault_count, usage.ru_maxrss / 1024);
+    }
+    free(size_list);
+    return verified ? 0 : 1;
+}
+
+/**
+ * FUNCTION: compare_output_files()
+ * Maps both files and compares them with memcmp. The golden file may end
+ * in extra newlines (correct.txt has a trailing blank line); any other
+ * difference fails. Returns 1 if the files match.
+ * */
+int compare_output_files(const char* output_path, const char* golden_path) {
+    const char* paths[2] = { output_path, golden_path };
+    unsigned char* data[2] = { NULL, NULL };
+    size_t sizes[2] = { 0, 0 };
+
+    for (int i = 0; i < 2; i++) {
+        int fd = open(paths[i], O_RDONLY);
+        struct stat file_status;
+        if (fd < 0 || fstat(fd, &file_status) != 0) {
+            return 0;
+        }
+        sizes[i] = (size_t)file_status.st_size;
+        if (sizes[i] > 0) {
+            void* mapping = mmap(NULL, sizes[i], PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                close(fd);
+                return 0;
+            }
+            data[i] = (unsigned char*)mapping;
+        }
+        close(fd);
+    }
+
+    int match = sizes[0] <= sizes[1] && (sizes[0] == 0 || memcmp(data[0], data[1], sizes[0]) == 0);
+    for (size_t i = sizes[0]; match && i < sizes[1]; i++) {
+        match = data[1][i] == '\n';
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (data[i] != NULL) {
+            munmap(data[i], sizes[i]);
+        }
+    }
+    return match;
+}
+
+/**
+ * FUNCTION: monotonic_nanoseconds()
+ * Returns CLOCK_MONOTONIC in nanoseconds.
+ * */
+static uint64_t monotonic_nanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * FUNCTION: shared_memory_name()
+ * POSIX shared memory names start with a single slash.
+ * */
+static void shared_memory_name(const char* name, char* buffer, size_t size) {
+    snprintf(buffer, size, "%s%s", name[0] == '/' ? "" : "/", name);
+}
+
+/**
+ * FUNCTION: create_live_statistics()
+ * Creates (or replaces) the named shared memory segment and maps it,
+ * noting the size of the nested TLB (0 if there is none). Returns NULL
+ * if the segment cannot be created.
+ * */
+LiveStatistics* create_live_statistics(const char* name, int tlb_entries) {
+    char path[256];
+    shared_memory_name(name, path, sizeof(path));
+    int fd = shm_open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(LiveStatistics)) != 0) {
+        return NULL;
+    }
+    void* mapping = mmap(NULL, sizeof(LiveStatistics), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return NULL;
+    }
+
+    LiveStatistics* live_statistics = (LiveStatistics*)mapping;
+    atomic_store(&live_statistics->start_time_ns, monotonic_nanoseconds());
+    atomic_store(&live_statistics->update_time_ns, atomic_load(&live_statistics->start_time_ns));
+    live_statistics->tlb_entries = (uint64_t)tlb_entries;
+    live_statistics->magic = LIVE_STATISTICS_MAGIC;
+    return live_statistics;
+}
+
+/**
+ * FUNCTION: publish_live_statistics()
+ * Writes the current counters under the seqlock.
+ * */
+void publish_live_statistics(LiveStatistics* live_statistics, PhysicalMemory* physical_memory, PageTable* page_table, int finished) {
+    uint64_t sequence = atomic_load_explicit(&live_statistics->sequence, memory_order_relaxed);
+    atomic_store_explicit(&live_statistics->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&live_statistics->address_count, physical_memory->address_count, memory_order_relaxed);
+    atomic_store_explicit(&live_statistics->fault_count, page_table->fault_count, memory_order_relaxed);
+    atomic_store_explicit(&live_statistics->eviction_count, physical_memory->eviction_count, memory_order_relaxed);
+    if (page_table->guest != NULL) {
+        atomic_store_explicit(&live_statistics->tlb_hits, page_table->guest->tlb_hits, memory_order_relaxed);
+    }
+    atomic_store_explicit(&live_statistics->update_time_ns, monotonic_nanoseconds(), memory_order_relaxed);
+    atomic_store_explicit(&live_statistics->finished, (uint64_t)finished, memory_order_relaxed);
+
+    atomic_store_explicit(&live_statistics->sequence, sequence + 2, memory_order_release);
+}
+
+/**
+ * FUNCTION: watch_live_statistics()
+ * Follows a running simulation's live statistics segment, printing one
+ * line per interval with the counters and the throughput since the last
+ * line, until the simulation finishes. The segment is mapped read-only,
+ * so watching cannot slow down or disturb the simulator. Gives up if the
+ * segment does not appear, or its counters stop being updated, for the
+ * timeout, as when the simulator died before finishing.
+ * */
+int watch_live_statistics(int argc, char* argv[]) {
+    uint64_t interval = WATCH_DEFAULT_INTERVAL_MS;
+    uint64_t timeout = WATCH_DEFAULT_TIMEOUT_MS;
+    const char* name = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc && parse_count(argv[i + 1], &interval) && interval > 0) {
+            i++;
+        } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc && parse_count(argv[i + 1], &timeout) && timeout > 0) {
+            i++;
+        } else if (argv[i][0] != '-' && name == NULL) {
+            name = argv[i];
+        } else {
+            name = NULL;
+            break;
+        }
+    }
+    if (name == NULL) {
+        printf("Usage: watch [--interval ms] [--timeout ms] name\n");
+        return -1;
+    }
+
+    /// Wait for the simulator to create the segment.
+    char path[256];
+    shared_memory_name(name, path, sizeof(path));
+    uint64_t timeout_ns = timeout * 1000000ULL;
+    uint64_t wait_start = monotonic_nanoseconds();
+    int fd;
+    while ((fd = shm_open(path, O_RDONLY, 0)) < 0) {
+        if (monotonic_nanoseconds() - wait_start > timeout_ns) {
+            printf("Error: the live statistics segment '%s' did not appear\n", name);
+            return -2;
+        }
+        usleep(100000);
+    }
+    LiveStatistics* live_statistics = (LiveStatistics*)mmap(NULL, sizeof(LiveStatistics), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if ((void*)live_statistics == MAP_FAILED) {
+        printf("Error: unable to map the live statistics segment '%s'\n", name);
+        return -2;
+    }
+    while (*(volatile uint64_t*)&live_statistics->magic != LIVE_STATISTICS_MAGIC) {
+        if (monotonic_nanoseconds() - wait_start > timeout_ns) {
+            printf("Error: '%s' is not a live statistics segment of this version\n", name);
+            munmap(live_statistics, sizeof(LiveStatistics));
+            return -2;
+        }
+        usleep(10000);
+    }
+
+    int tlb = live_statistics->tlb_entries > 0;
+    printf("%10s %16s %14s %14s %10s %14s", "elapsed s", "addresses", "faults", "evictions", "fault rate", "addresses/s");
+    if (tlb) {
+        printf(" %14s", "TLB hits");
+    }
+    printf("\n");
+    uint64_t last_addresses = 0;
+    uint64_t last_time = 0;
+    uint64_t last_change = monotonic_nanoseconds();
+    int status = 0;
+    for (;;) {
+        /// Copy a consistent snapshot: retry while a write is in progress or happened meanwhile.
+        uint64_t sequence, addresses, faults, evictions, tlb_hits, start, update, finished;
+        do {
+            sequence = atomic_load_explicit(&live_statistics->sequence, memory_order_acquire);
+            addresses = atomic_load_explicit(&live_statistics->address_count, memory_order_relaxed);
+            faults = atomic_load_explicit(&live_statistics->fault_count, memory_order_relaxed);
+            evictions = atomic_load_explicit(&live_statistics->eviction_count, memory_order_relaxed);
+            tlb_hits = atomic_load_explicit(&live_statistics->tlb_hits, memory_order_relaxed);
+            start = atomic_load_explicit(&live_statistics->start_time_ns, memory_order_relaxed);
+            update = atomic_load_explicit(&live_statistics->update_time_ns, memory_order_relaxed);
+            finished = atomic_load_explicit(&live_statistics->finished, memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+        } while ((sequence & 1) != 0 || sequence != atomic_load_explicit(&live_statistics->sequence, memory_order_relaxed));
+
+        if (update != last_time) {
+            double seconds = last_time > 0 ? (double)(update - last_time) / 1e9 : (double)(update - start) / 1e9;
+            printf("%10.1f %16" PRIu64 " %14" PRIu64 " %14" PRIu64 " %10.3f %14.0f", (double)(update - start) / 1e9,
+                   addresses, faults, evictions, addresses > 0 ? (double)faults / (double)addresses : 0.0,
+                   seconds > 0.0 ? (double)(addresses - last_addresses) / seconds : 0.0);
+            if (tlb) {
+                printf(" %14" PRIu64, tlb_hits);
+            }
+            printf("\n");
+            fflush(stdout);
+            last_addresses = addresses;
+            last_time = update;
+            last_change = monotonic_nanoseconds();
+        }
+        if (finished) {
+            break;
+        }
+        if (monotonic_nanoseconds() - last_change > timeout_ns) {
+            printf("Error: the simulation stopped updating '%s' without finishing\n", name);
+            status = -3;
+            break;
+        }
+        usleep((useconds_t)(interval * 1000));
+    }
+    munmap(live_statistics, sizeof(LiveStatistics));
+    return status;
+}
+
+/**
+ * FUNCTION: create_heatmap()
+ * Allocates the per-page counters for page_count pages and opens the
+ * heatmap file. CSV files get a header row; binary files start with the
+ * magic VMMHEAT1 and hold fixed 40-byte little-endian records (window,
+ * page, accesses, faults, evictions, padding, last access). Returns NULL
+ * if the counters or the file cannot be created.
+ * */
+Heatmap* create_heatmap(uint64_t page_count, uint64_t window_size, const char* path, int binary) {
+    Heatmap* new_heatmap = (Heatmap*)calloc(1, sizeof(Heatmap));
+    new_heatmap->pages = (PageHeat*)calloc(page_count, sizeof(PageHeat));
+    new_heatmap->file = fopen(path, binary ? "wb" : "w");
+    if (new_heatmap->pages == NULL || new_heatmap->file == NULL) {
+        return NULL;
+    }
+    new_heatmap->window_size = window_size;
+    new_heatmap->binary = binary;
+    if (binary) {
+        fwrite(HEATMAP_BINARY_MAGIC, 1, 8, new_heatmap->file);
+    } else {
+        fprintf(new_heatmap->file, "window,page,accesses,faults,evictions,last_access\n");
+    }
+    return new_heatmap;
+}
+
+/**
+ * FUNCTION: touch_page_heat()
+ * Returns the counters of a page for the current window, resetting them
+ * and adding the page to the window's list on its first touch.
+ * */
+PageHeat* touch_page_heat(Heatmap* heatmap, uint64_t page_number) {
+    PageHeat* heat = &heatmap->pages[page_number];
+
+    /// Windows are stamped one higher than their number, so zeroed counters belong to no window.
+    if (heat->window != (uint32_t)(heatmap->window + 1)) {
+        heat->window = (uint32_t)(heatmap->window + 1);
+        heat->accesses = 0;
+        heat->faults = 0;
+        heat->evictions = 0;
+        if (heatmap->touched_count == heatmap->touched_capacity) {
+            heatmap->touched_capacity = heatmap->touched_capacity ? heatmap->touched_capacity * 2 : 1024;
+            heatmap->touched_pages = (uint64_t*)realloc(heatmap->touched_pages, sizeof(uint64_t) * heatmap->touched_capacity);
+        }
+        heatmap->touched_pages[heatmap->touched_count++] = page_number;
+    }
+    return heat;
+}
+
+/**
+ * FUNCTION: record_page_access()
+ * Counts one access (and whether it faulted) for a page, closing the
+ * current window first if it is full.
+ * */
+void record_page_access(Heatmap* heatmap, uint64_t page_number, int faulted) {
+    if (heatmap->window_position == heatmap->window_size) {
+        close_heatmap_window(heatmap);
+    }
+    PageHeat* heat = touch_page_heat(heatmap, page_number);
+    heat->accesses++;
+    heat->faults += (uint32_t)faulted;
+    heat->last_access = heatmap->access_index++;
+    heatmap->window_position++;
+}
+
+/// Orders page numbers for qsort().
+static int compare_page_numbers(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * FUNCTION: close_heatmap_window()
+ * Writes a row for every page touched in the current window, in page
+ * order, and starts the next window.
+ * */
+void close_heatmap_window(Heatmap* heatmap) {
+    qsort(heatmap->touched_pages, heatmap->touched_count, sizeof(uint64_t), compare_page_numbers);
+    for (uint64_t i = 0; i < heatmap->touched_count; i++) {
+        uint64_t page_number = heatmap->touched_pages[i];
+        PageHeat* heat = &heatmap->pages[page_number];
+        if (heatmap->binary) {
+            uint64_t fields[5] = {
+                heatmap->window, page_number,
+                (uint64_t)heat->accesses | ((uint64_t)heat->faults << 32),
+                (uint64_t)heat->evictions,
+                heat->last_access
+            };
+            unsigned char record[40];
+            for (int field = 0; field < 5; field++) {
+                for (int byte = 0; byte < 8; byte++) {
+                    record[field * 8 + byte] = (unsigned char)(fields[field] >> (8 * byte));
+                }
+            }
+            fwrite(record, 1, sizeof(record), heatmap->file);
+        } else {
+            fprintf(heatmap->file, "%" PRIu64 ",%" PRIu64 ",%u,%u,%u,%" PRIu64 "\n", heatmap->window, page_number,
+                    heat->accesses, heat->faults, heat->evictions, heat->last_access);
+        }
+    }
+    heatmap->touched_count = 0;
+    heatmap->window_position = 0;
+    heatmap->window++;
+}
+
+/**
+ * FUNCTION: close_heatmap()
+ * Writes the last, possibly partial, window and closes the heatmap file.
+ * Returns 0 if the file could not be written.
+ * */
+int close_heatmap(Heatmap* heatmap) {
+    if (heatmap->touched_count > 0) {
+        close_heatmap_window(heatmap);
+    }
+    return fclose(heatmap->file) == 0;
+}
+
+/**
+ * FUNCTION: start_hot_pages()
+ * Allocates the Space-Saving counters used to find the top_count
+ * hottest pages. counter_count defaults to HOT_PAGES_COUNTERS_PER_PAGE
+ * counters per reported page; more counters tighten the error bound.
+ * Returns 0 if the counters could not be allocated.
+ * */
+int start_hot_pages(int top_count, uint64_t counter_count) {
+    if (counter_count == 0) {
+        counter_count = (uint64_t)top_count * HOT_PAGES_COUNTERS_PER_PAGE;
+        if (counter_count < HOT_PAGES_MIN_COUNTERS) {
+            counter_count = HOT_PAGES_MIN_COUNTERS;
+        }
+    }
+    if (counter_count < (uint64_t)top_count) {
+        counter_count = (uint64_t)top_count;
+    }
+
+    /// Keep the hash table at most half full so probe sequences stay short.
+    int table_bits = 1;
+    while (((uint64_t)1 << table_bits) < 2 * counter_count) {
+        table_bits++;
+    }
+
+    memset(&hot_pages, 0, sizeof(hot_pages));
+    hot_pages.top_count = top_count;
+    hot_pages.counter_count = (uint32_t)counter_count;
+    hot_pages.table_bits = table_bits;
+    hot_pages.counters = (HotPageCounter*)calloc(counter_count, sizeof(HotPageCounter));
+    hot_pages.heap = (uint32_t*)malloc(sizeof(uint32_t) * counter_count);
+    hot_pages.table = (uint32_t*)malloc(sizeof(uint32_t) << table_bits);
+    if (hot_pages.counters == NULL || hot_pages.heap == NULL || hot_pages.table == NULL) {
+        return 0;
+    }
+    memset(hot_pages.table, 0xff, sizeof(uint32_t) << table_bits);
+    hot_pages.enabled = 1;
+    return 1;
+}
+
+/// Returns the home slot of a page in the hot page hash table.
+static inline uint64_t hot_page_slot(uint64_t page_number) {
+    return (page_number * 0x9E3779B97F4A7C15ULL) >> (64 - hot_pages.table_bits);
+}
+
+/// Moves a counter whose count grew down the min-heap to its place.
+static void sift_hot_page_down(uint32_t position) {
+    uint32_t counter = hot_pages.heap[position];
+    uint64_t count = hot_pages.counters[counter].count;
+    for (;;) {
+        uint32_t child = 2 * position + 1;
+        if (child >= hot_pages.used_count) {
+            break;
+        }
+        if (child + 1 < hot_pages.used_count &&
+            hot_pages.counters[hot_pages.heap[child + 1]].count < hot_pages.counters[hot_pages.heap[child]].count) {
+            child++;
+        }
+        if (hot_pages.counters[hot_pages.heap[child]].count >= count) {
+            break;
+        }
+        hot_pages.heap[position] = hot_pages.heap[child];
+        hot_pages.counters[hot_pages.heap[position]].heap_index = position;
+        position = child;
+    }
+    hot_pages.heap[position] = counter;
+    hot_pages.counters[counter].heap_index = position;
+}
+
+/// Removes a page from the hash table, shifting back later entries of its probe run.
+static void remove_hot_page_slot(uint64_t page_number) {
+    uint64_t mask = ((uint64_t)1 << hot_pages.table_bits) - 1;
+    uint64_t hole = hot_page_slot(page_number);
+    while (hot_pages.counters[hot_pages.table[hole]].page_number != page_number) {
+        hole = (hole + 1) & mask;
+    }
+    for (uint64_t next = (hole + 1) & mask; hot_pages.table[next] != HOT_PAGES_EMPTY; next = (next + 1) & mask) {
+        uint64_t home = hot_page_slot(hot_pages.counters[hot_pages.table[next]].page_number);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            hot_pages.table[hole] = hot_pages.table[next];
+            hole = next;
+        }
+    }
+    hot_pages.table[hole] = HOT_PAGES_EMPTY;
+}
+
+/**
+ * FUNCTION: record_hot_page()
+ * Counts one access to a page. A page without a counter takes a free
+ * one, or else replaces the page with the smallest count, inheriting
+ * that count as its error bound.
+ * */
+void record_hot_page(uint64_t page_number) {
+    uint64_t mask = ((uint64_t)1 << hot_pages.table_bits) - 1;
+    uint64_t slot = hot_page_slot(page_number);
+    hot_pages.address_count++;
+
+    /// Count the access if the page already has a counter.
+    for (; hot_pages.table[slot] != HOT_PAGES_EMPTY; slot = (slot + 1) & mask) {
+        HotPageCounter* counter = &hot_pages.counters[hot_pages.table[slot]];
+        if (counter->page_number == page_number) {
+            counter->count++;
+            sift_hot_page_down(counter->heap_index);
+            return;
+        }
+    }
+
+    /// Otherwise give it a free counter, or take over the smallest one.
+    uint32_t index;
+    uint64_t error = 0;
+    if (hot_pages.used_count < hot_pages.counter_count) {
+        index = hot_pages.used_count;
+        hot_pages.heap[index] = index;
+        hot_pages.counters[index].heap_index = index;
+        hot_pages.used_count++;
+    } else {
+        index = hot_pages.heap[0];
+        error = hot_pages.counters[index].count;
+        remove_hot_page_slot(hot_pages.counters[index].page_number);
+        slot = hot_page_slot(page_number);
+        while (hot_pages.table[slot] != HOT_PAGES_EMPTY) {
+            slot = (slot + 1) & mask;
+        }
+    }
+    hot_pages.table[slot] = index;
+    hot_pages.counters[index].page_number = page_number;
+    hot_pages.counters[index].count = error + 1;
+    hot_pages.counters[index].error = error;
+    sift_hot_page_down(hot_pages.counters[index].heap_index);
+}
+
+/// Orders hot page counters by descending count for qsort().
+static int compare_hot_pages(const void* a, const void* b) {
+    uint64_t x = ((const HotPageCounter*)a)->count;
+    uint64_t y = ((const HotPageCounter*)b)->count;
+    return (x < y) - (x > y);
+}
+
+/**
+ * FUNCTION: report_hot_pages()
+ * Prints the hottest pages to stderr with their estimated access counts
+ * and the range the true count lies in.
+ * */
+void report_hot_pages() {
+    hot_pages.enabled = 0;
+    qsort(hot_pages.counters, hot_pages.used_count, sizeof(HotPageCounter), compare_hot_pages);
+
+    uint64_t bound = hot_pages.address_count / hot_pages.counter_count;
+    fprintf(stderr, "Hot pages: %u counters, %" PRIu64 " accesses, counts overestimate by at most %" PRIu64 "\n",
+            hot_pages.counter_count, hot_pages.address_count, bound);
+    fprintf(stderr, "  %6s %18s %14s %14s %8s\n", "rank", "page", "estimate", "at least", "share");
+    int shown = hot_pages.top_count < (int)hot_pages.used_count ? hot_pages.top_count : (int)hot_pages.used_count;
+    for (int i = 0; i < shown; i++) {
+        HotPageCounter* counter = &hot_pages.counters[i];
+        fprintf(stderr, "  %6d %18" PRIu64 " %14" PRIu64 " %14" PRIu64 " %7.3f%%\n", i + 1, counter->page_number,
+                counter->count, counter->count - counter->error, 100.0 * (double)counter->count / (double)hot_pages.address_count);
+    }
+
+    free(hot_pages.counters);
+    free(hot_pages.heap);
+    free(hot_pages.table);
+}
+
+/**
+ * FUNCTION: create_prefetcher()
+ * Creates the prefetcher with the given name, loading up to degree pages
+ * ahead per prediction. Returns NULL if there is no prefetcher with that
+ * name.
+ * */
+Prefetcher* create_prefetcher(const char* name, int frame_count, uint64_t page_count, int degree, int table_size) {
+    for (int i = 0; prefetchers[i].name != NULL; i++) {
+        if (strcmp(name, prefetchers[i].name) == 0) {
+            Prefetcher* new_prefetcher = prefetchers[i].create(table_size);
+            new_prefetcher->name = prefetchers[i].name;
+            new_prefetcher->degree = degree;
+            new_prefetcher->frame_prefetched = (unsigned char*)calloc(frame_count, sizeof(unsigned char));
+            new_prefetcher->evicted_pages = (uint64_t*)calloc((page_count + 63) / 64, sizeof(uint64_t));
+            return new_prefetcher;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * FUNCTION: prefetch_pages()
+ * Asks the prefetcher which pages follow page_number and loads those in
+ * the address space that are not already resident.
+ * */
+void prefetch_pages(PhysicalMemory* physical_memory, PageTable* page_table, BackingStore* backing_store, uint64_t page_number, int missed) {
+    Prefetcher* prefetcher = physical_memory->prefetcher;
+    uint64_t pages[PREFETCH_MAX_DEGREE];
+    int page_count = prefetcher->predict(prefetcher->state, page_number, missed, pages, prefetcher->degree);
+    for (int i = 0; i < page_count; i++) {
+        if (pages[i] < page_table->page_count && pages[i] != page_number && page_table->map[pages[i]] == UNMAPPED) {
+            load_page(physical_memory, page_table, backing_store, pages[i], LOAD_PREFETCH);
+            prefetcher->issued++;
+        }
+    }
+}
+
+/**
+ * FUNCTION: report_prefetcher()
+ * Prints how effective the prefetcher was: accuracy is the share of
+ * prefetched pages that were used, coverage the share of misses that
+ * prefetching removed.
+ * */
+void report_prefetcher(Prefetcher* prefetcher, uint64_t fault_count, FILE* stream) {
+    uint64_t misses = prefetcher->useful + fault_count;
+    fprintf(stream, "Prefetch (%s, degree %d): %" PRIu64 " issued, %" PRIu64 " useful, %" PRIu64 " evicted unused\n",
+            prefetcher->name, prefetcher->degree, prefetcher->issued, prefetcher->useful, prefetcher->unused);
+    fprintf(stream, "Prefetch: accuracy %.1f%%, coverage %.1f%%, pollution %" PRIu64 " faults on pages evicted by prefetches\n",
+            prefetcher->issued > 0 ? 100.0 * (double)prefetcher->useful / (double)prefetcher->issued : 0.0,
+            misses > 0 ? 100.0 * (double)prefetcher->useful / (double)misses : 0.0, prefetcher->polluting_faults);
+}
+
+/**
+ * STRUCT: StrideStream
+ * One access stream followed by the stride prefetcher: the last page it
+ * touched, the stride between its last two pages, how many times in a
+ * row that stride has repeated, and when the stream was last used.
+ * */
+struct StrideStream {
+    uint64_t last_page;
+    int64_t stride;
+    int confidence;
+    uint64_t last_use;
+} typedef StrideStream;
+
+/**
+ * STRUCT: StridePrefetcher
+ * A table of streams. Each access joins the stream whose last page is
+ * closest (within STRIDE_MAX_DISTANCE pages), or replaces the least
+ * recently used stream. Once a stream's stride repeats, the next pages
+ * along it are predicted.
+ * */
+struct StridePrefetcher {
+    int stream_count;
+    uint64_t clock;
+    StrideStream* streams;
+} typedef StridePrefetcher;
+
+static int stride_predict(void* state, uint64_t page_number, int missed, uint64_t* pages, int max_pages) {
+    StridePrefetcher* stride = (StridePrefetcher*)state;
+    StrideStream* closest = NULL;
+    StrideStream* oldest = &stride->streams[0];
+    uint64_t closest_distance = STRIDE_MAX_DISTANCE + 1;
+    (void)missed;
+
+    stride->clock++;
+    for (int i = 0; i < stride->stream_count; i++) {
+        StrideStream* stream = &stride->streams[i];
+        uint64_t distance = page_number > stream->last_page ? page_number - stream->last_page : stream->last_page - page_number;
+        if (distance < closest_distance) {
+            closest = stream;
+            closest_distance = distance;
+        }
+        if (stream->last_use < oldest->last_use) {
+            oldest = stream;
+        }
+    }
+
+    /// Repeated accesses to a page say nothing about the stride.
+    if (closest != NULL && closest_distance == 0) {
+        closest->last_use = stride->clock;
+        return 0;
+    }
+    if (closest == NULL) {
+        oldest->last_page = page_number;
+        oldest->stride = 0;
+        oldest->confidence = 0;
+        oldest->last_use = stride->clock;
+        return 0;
+    }
+
+    int64_t delta = (int64_t)(page_number - closest->last_page);
+    if (delta == closest->stride) {
+        closest->confidence += closest->confidence < 3;
+    } else {
+        closest->stride = delta;
+        closest->confidence = 0;
+    }
+    closest->last_page = page_number;
+    closest->last_use = stride->clock;
+    if (closest->confidence == 0) {
+        return 0;
+    }
+
+    int page_count = 0;
+    uint64_t next_page = page_number;
+    while (page_count < max_pages) {
+        next_page += (uint64_t)delta;
+        if ((delta > 0 && next_page < page_number) || (delta < 0 && next_page > page_number)) {
+            break;
+        }
+        pages[page_count++] = next_page;
+    }
+    return page_count;
+}
+
+/**
+ * FUNCTION: create_stride_prefetcher()
+ * Creates a stride prefetcher following table_size streams.
+ * */
+Prefetcher* create_stride_prefetcher(int table_size) {
+    StridePrefetcher* stride = (StridePrefetcher*)calloc(1, sizeof(StridePrefetcher));
+    stride->stream_count = table_size > 0 ? table_size : STRIDE_DEFAULT_STREAMS;
+    stride->streams = (StrideStream*)calloc(stride->stream_count, sizeof(StrideStream));
+
+    /// Unused streams sit far from every page so they are only ever replaced.
+    for (int i = 0; i < stride->stream_count; i++) {
+        stride->streams[i].last_page = UINT64_MAX / 2;
+    }
+
+    Prefetcher* new_prefetcher = (Prefetcher*)calloc(1, sizeof(Prefetcher));
+    new_prefetcher->state = stride;
+    new_prefetcher->predict = stride_predict;
+    return new_prefetcher;
+}
+
+/**
+ * STRUCT: MarkovEntry
+ * The pages that have missed right after a page, most recent first.
+ * Pages are stored plus one so that zero marks an empty slot.
+ * */
+struct MarkovEntry {
+    uint64_t page_tag;
+    uint64_t successors[MARKOV_SUCCESSORS];
+} typedef MarkovEntry;
+
+/**
+ * STRUCT: MarkovPrefetcher
+ * A correlation prefetcher. A direct-mapped table, bounded at a power of
+ * two entries, learns which pages miss after each page; on every miss
+ * it records the transition from the previous miss and predicts the
+ * learned successors of the missing page.
+ * */
+struct MarkovPrefetcher {
+    int table_bits;
+    uint64_t last_miss_tag;
+    MarkovEntry* entries;
+} typedef MarkovPrefetcher;
+
+static inline MarkovEntry* markov_entry(MarkovPrefetcher* markov, uint64_t page_number) {
+    return &markov->entries[(page_number * 0x9E3779B97F4A7C15ULL) >> (64 - markov->table_bits)];
+}
+
+static int markov_predict(void* state, uint64_t page_number, int missed, uint64_t* pages, int max_pages) {
+    MarkovPrefetcher* markov = (MarkovPrefetcher*)state;
+    if (!missed) {
+        return 0;
+    }
+
+    /// Learn the transition from the previous miss, moving it to the front of that page's successors.
+    if (markov->last_miss_tag != 0) {
+        MarkovEntry* entry = markov_entry(markov, markov->last_miss_tag - 1);
+        if (entry->page_tag != markov->last_miss_tag) {
+            memset(entry, 0, sizeof(MarkovEntry));
+            entry->page_tag = markov->last_miss_tag;
+        }
+        int position = 0;
+        while (position < MARKOV_SUCCESSORS - 1 && entry->successors[position] != page_number + 1) {
+            position++;
+        }
+        for (; position > 0; position--) {
+            entry->successors[position] = entry->successors[position - 1];
+        }
+        entry->successors[0] = page_number + 1;
+    }
+    markov->last_miss_tag = page_number + 1;
+
+    MarkovEntry* entry = markov_entry(markov, page_number);
+    int page_count = 0;
+    if (entry->page_tag == page_number + 1) {
+        for (int i = 0; i < MARKOV_SUCCESSORS && page_count < max_pages && entry->successors[i] != 0; i++) {
+            pages[page_count++] = entry->successors[i] - 1;
+        }
+    }
+    return page_count;
+}
+
+/**
+ * FUNCTION: create_markov_prefetcher()
+ * Creates a Markov prefetcher with at least table_size entries.
+ * */
+Prefetcher* create_markov_prefetcher(int table_size) {
+    MarkovPrefetcher* markov = (MarkovPrefetcher*)calloc(1, sizeof(MarkovPrefetcher));
+    int entry_count = table_size > 0 ? table_size : MARKOV_DEFAULT_ENTRIES;
+    markov->table_bits = 1;
+    while ((1 << markov->table_bits) < entry_count) {
+        markov->table_bits++;
+    }
+    markov->entries = (MarkovEntry*)calloc((size_t)1 << markov->table_bits, sizeof(MarkovEntry));
+
+    Prefetcher* new_prefetcher = (Prefetcher*)calloc(1, sizeof(Prefetcher));
+    new_prefetcher->state = markov;
+    new_prefetcher->predict = markov_predict;
+    return new_prefetcher;
+}
+
+/**
+ * FUNCTION: create_page_cache()
+ * Creates an empty page cache holding up to capacity pages. Returns NULL
+ * if its memory could not be allocated.
+ * */
+PageCache* create_page_cache(int capacity) {
+    PageCache* new_page_cache = (PageCache*)calloc(1, sizeof(PageCache));
+    new_page_cache->capacity = capacity;
+    new_page_cache->pages = (uint64_t*)calloc(capacity, sizeof(uint64_t));
+    new_page_cache->space = (signed char*)malloc((size_t)capacity * PAGE_SIZE);
+    int* prev = (int*)malloc(sizeof(int) * capacity);
+    int* next = (int*)malloc(sizeof(int) * capacity);
+    if (new_page_cache->pages == NULL || new_page_cache->space == NULL || prev == NULL || next == NULL) {
+        return NULL;
+    }
+    init_frame_list(&new_page_cache->lru, prev, next);
+    init_page_index(&new_page_cache->index, capacity);
+
+    /// Free slots are chained through the list links.
+    for (int i = 0; i < capacity; i++) {
+        next[i] = i + 1 < capacity ? i + 1 : UNMAPPED;
+    }
+    new_page_cache->free_slot = 0;
+    return new_page_cache;
+}
+
+/**
+ * FUNCTION: page_is_cached()
+ * Returns 1 if page_number is in the page cache.
+ * */
+int page_is_cached(PageCache* page_cache, uint64_t page_number) {
+    return find_page_index(&page_cache->index, page_cache->pages, page_number) != UNMAPPED;
+}
+
+/**
+ * FUNCTION: take_cached_page()
+ * Copies page_number out of the page cache into destination and drops
+ * it from the cache. Returns 0 if the page is not cached.
+ * */
+int take_cached_page(PageCache* page_cache, uint64_t page_number, signed char* destination) {
+    int slot = find_page_index(&page_cache->index, page_cache->pages, page_number);
+    if (slot == UNMAPPED) {
+        return 0;
+    }
+    memcpy(destination, page_cache->space + (size_t)slot * PAGE_SIZE, PAGE_SIZE);
+    remove_page_index(&page_cache->index, page_cache->pages, slot);
+    remove_frame_list(&page_cache->lru, slot);
+    page_cache->lru.next[slot] = page_cache->free_slot;
+    page_cache->free_slot = slot;
+    return 1;
+}
+
+/**
+ * FUNCTION: cache_evicted_page()
+ * Keeps a copy of a page evicted from its frame, dropping the least
+ * recently cached page if the cache is full.
+ * */
+void cache_evicted_page(PageCache* page_cache, uint64_t page_number, const signed char* source) {
+    int slot = page_cache->free_slot;
+    if (slot != UNMAPPED) {
+        page_cache->free_slot = page_cache->lru.next[slot];
+    } else {
+        slot = page_cache->lru.tail;
+        remove_page_index(&page_cache->index, page_cache->pages, slot);
+        remove_frame_list(&page_cache->lru, slot);
+    }
+    page_cache->pages[slot] = page_number;
+    memcpy(page_cache->space + (size_t)slot * PAGE_SIZE, source, PAGE_SIZE);
+    insert_page_index(&page_cache->index, page_cache->pages, slot);
+    push_frame_list(&page_cache->lru, slot);
+}
+
+/**
+ * FUNCTION: report_page_cache()
+ * Prints the split between minor and major faults and, with fault-around,
+ * how many pages it mapped and how many later minor faults that avoided.
+ * */
+void report_page_cache(PhysicalMemory* physical_memory, PageTable* page_table, FILE* stream) {
+    fprintf(stream, "Page cache (%d pages): %" PRIu64 " minor faults, %" PRIu64 " major faults\n",
+            physical_memory->page_cache->capacity, page_table->minor_fault_count,
+            page_table->fault_count - page_table->minor_fault_count);
+    if (physical_memory->fault_around_pages > 0) {
+        fprintf(stream, "Fault-around (%d pages): %" PRIu64 " pages mapped, %" PRIu64 " minor faults avoided\n",
+                physical_memory->fault_around_pages, page_table->fault_around_count, page_table->fault_around_hits);
+    }
+}
+
+/**
+ * FUNCTION: create_memory_tiers()
+ * Splits frame_count frames into tiers: the last options->slow_frame_count
+ * frames start in the slow tier, the rest in the fast tier.
+ * */
+MemoryTiers* create_memory_tiers(int frame_count, Options* options) {
+    MemoryTiers* new_tiers = (MemoryTiers*)calloc(1, sizeof(MemoryTiers));
+    new_tiers->slow_count = options->slow_frame_count;
+    new_tiers->fast_count = frame_count - options->slow_frame_count;
+    new_tiers->fast_latency = options->fast_latency;
+    new_tiers->slow_latency = options->slow_latency;
+    new_tiers->migration_cost = options->migration_cost;
+    new_tiers->promote_threshold = options->promote_threshold;
+    new_tiers->sample_interval = options->tier_sample_interval;
+    new_tiers->frame_tiers = (unsigned char*)malloc(sizeof(unsigned char) * frame_count);
+    new_tiers->tier_positions = (int*)malloc(sizeof(int) * frame_count);
+    new_tiers->fast_frames = (int*)malloc(sizeof(int) * new_tiers->fast_count);
+    new_tiers->slow_frames = (int*)malloc(sizeof(int) * new_tiers->slow_count);
+    new_tiers->heat = (uint16_t*)calloc(frame_count, sizeof(uint16_t));
+    new_tiers->heat_epochs = (uint32_t*)calloc(frame_count, sizeof(uint32_t));
+    for (int frame_number = 0; frame_number < frame_count; frame_number++) {
+        if (frame_number < new_tiers->fast_count) {
+            new_tiers->frame_tiers[frame_number] = TIER_FAST;
+            new_tiers->tier_positions[frame_number] = frame_number;
+            new_tiers->fast_frames[frame_number] = frame_number;
+        } else {
+            new_tiers->frame_tiers[frame_number] = TIER_SLOW;
+            new_tiers->tier_positions[frame_number] = frame_number - new_tiers->fast_count;
+            new_tiers->slow_frames[frame_number - new_tiers->fast_count] = frame_number;
+        }
+    }
+    return new_tiers;
+}
+
+/// Returns a frame's access count, halved once for every epoch since it was last looked at.
+static inline int tier_heat(MemoryTiers* tiers, int frame_number, uint32_t epoch) {
+    uint32_t elapsed = epoch - tiers->heat_epochs[frame_number];
+    if (elapsed > 0) {
+        tiers->heat[frame_number] = elapsed < 16 ? (uint16_t)(tiers->heat[frame_number] >> elapsed) : 0;
+        tiers->heat_epochs[frame_number] = epoch;
+    }
+    return tiers->heat[frame_number];
+}
+
+/**
+ * FUNCTION: record_tier_access()
+ * Counts an access in the tier of its frame and, for sampled accesses,
+ * in the frame's hotness, promoting the page if it is a hot slow page.
+ * */
+void record_tier_access(MemoryTiers* tiers, int frame_number) {
+    tiers->accesses[tiers->frame_tiers[frame_number]]++;
+    if (++tiers->access_index % (uint64_t)tiers->sample_interval != 0) {
+        return;
+    }
+    uint32_t epoch = (uint32_t)(tiers->access_index / TIER_EPOCH_ACCESSES);
+    int heat = tier_heat(tiers, frame_number, epoch);
+    if (heat < UINT16_MAX) {
+        tiers->heat[frame_number]++;
+    }
+    if (tiers->frame_tiers[frame_number] != TIER_SLOW || heat + 1 < tiers->promote_threshold) {
+        return;
+    }
+
+    /// Find a cold fast page to demote, cooling the hot ones on the way.
+    int demoted;
+    for (;;) {
+        demoted = tiers->fast_frames[tiers->demotion_hand];
+        tiers->demotion_hand = (tiers->demotion_hand + 1) % tiers->fast_count;
+        if (tier_heat(tiers, demoted, epoch) < tiers->promote_threshold) {
+            break;
+        }
+        tiers->heat[demoted] >>= 1;
+    }
+
+    /// Exchange the tiers of the two frames.
+    int fast_position = tiers->tier_positions[demoted];
+    int slow_position = tiers->tier_positions[frame_number];
+    tiers->fast_frames[fast_position] = frame_number;
+    tiers->slow_frames[slow_position] = demoted;
+    tiers->tier_positions[frame_number] = fast_position;
+    tiers->tier_positions[demoted] = slow_position;
+    tiers->frame_tiers[frame_number] = TIER_FAST;
+    tiers->frame_tiers[demoted] = TIER_SLOW;
+    tiers->promotions++;
+}
+
+/**
+ * FUNCTION: report_memory_tiers()
+ * Prints the share of accesses served by each tier, the migrations, and
+ * the simulated memory time: every access at its tier's latency plus
+ * every migration at its cost.
+ * */
+void report_memory_tiers(MemoryTiers* tiers, FILE* stream) {
+    uint64_t access_count = tiers->accesses[TIER_FAST] + tiers->accesses[TIER_SLOW];
+    uint64_t migrations = tiers->promotions * 2;
+    double access_time = (double)tiers->accesses[TIER_FAST] * tiers->fast_latency + (double)tiers->accesses[TIER_SLOW] * tiers->slow_latency;
+    double migration_time = (double)migrations * tiers->migration_cost;
+    fprintf(stream, "Tiers: fast %d frames (%.0f ns), slow %d frames (%.0f ns)\n",
+            tiers->fast_count, tiers->fast_latency, tiers->slow_count, tiers->slow_latency);
+    fprintf(stream, "Tiers: %.1f%% of accesses fast, %.1f%% slow, %" PRIu64 " promotions, %" PRIu64 " demotions\n",
+            access_count > 0 ? 100.0 * (double)tiers->accesses[TIER_FAST] / (double)access_count : 0.0,
+            access_count > 0 ? 100.0 * (double)tiers->accesses[TIER_SLOW] / (double)access_count : 0.0,
+            tiers->promotions, tiers->promotions);
+    fprintf(stream, "Tiers: simulated time %.3f ms (%.3f ms accesses, %.3f ms migrations)\n",
+            (access_time + migration_time) / 1e6, access_time / 1e6, migration_time / 1e6);
+}
+
+/**
+ * FUNCTION: create_numa_memory()
+ * Splits frame_count frames into options->numa_node_count nodes of
+ * consecutive frames, all free, with the CPUs spread evenly over them.
+ * */
+NumaMemory* create_numa_memory(int frame_count, Options* options) {
+    NumaMemory* new_numa = (NumaMemory*)calloc(1, sizeof(NumaMemory));
+    new_numa->node_count = options->numa_node_count;
+    new_numa->cpu_count = options->numa_cpu_count;
+    new_numa->policy = options->numa_policy;
+    new_numa->preferred_node = options->numa_preferred_node;
+    new_numa->quantum = options->numa_quantum;
+    new_numa->quantum_left = options->numa_quantum;
+    new_numa->scan_period = options->numa_balancing_period;
+    new_numa->scan_left = options->numa_balancing_period;
+    new_numa->local_latency = options->local_latency;
+    new_numa->remote_latency = options->remote_latency;
+    new_numa->migration_cost = options->migration_cost;
+    new_numa->frame_nodes = (unsigned char*)malloc(sizeof(unsigned char) * frame_count);
+    new_numa->frame_last_nodes = (signed char*)malloc(sizeof(signed char) * frame_count);
+    new_numa->frame_positions = (int*)malloc(sizeof(int) * frame_count);
+    new_numa->node_frames = (int*)malloc(sizeof(int) * frame_count);
+    for (int node = 0; node <= new_numa->node_count; node++) {
+        new_numa->node_first[node] = (int)((int64_t)frame_count * node / new_numa->node_count);
+    }
+    for (int node = 0; node < new_numa->node_count; node++) {
+        for (int frame_number = new_numa->node_first[node]; frame_number < new_numa->node_first[node + 1]; frame_number++) {
+            new_numa->frame_nodes[frame_number] = (unsigned char)node;
+            new_numa->frame_last_nodes[frame_number] = UNMAPPED;
+            new_numa->frame_positions[frame_number] = frame_number;
+            new_numa->node_frames[frame_number] = frame_number;
+        }
+    }
+    return new_numa;
+}
+
+/**
+ * FUNCTION: allocate_numa_frame()
+ * Takes a free frame for a page faulted in by the current CPU: on its
+ * home node, on the next node in turn, or on the preferred node, as the
+ * policy says, falling back to the following nodes when that one is
+ * full. There has to be a free frame somewhere.
+ * */
+int allocate_numa_frame(NumaMemory* numa) {
+    int node = numa->home_node;
+    if (numa->policy == NUMA_INTERLEAVE) {
+        node = numa->interleave_next;
+        numa->interleave_next = (numa->interleave_next + 1) % numa->node_count;
+    } else if (numa->policy == NUMA_PREFERRED) {
+        node = numa->preferred_node;
+    }
+    while (numa->node_first[node] + numa->node_used[node] == numa->node_first[node + 1]) {
+        node = (node + 1) % numa->node_count;
+    }
+    return numa->node_frames[numa->node_first[node] + numa->node_used[node]++];
+}
+
+/// Swaps the frames at two positions of node_frames, and with them their nodes.
+static void swap_numa_positions(NumaMemory* numa, int position, int other_position) {
+    int frame_number = numa->node_frames[position];
+    int other_frame = numa->node_frames[other_position];
+    unsigned char node = numa->frame_nodes[frame_number];
+    numa->node_frames[position] = other_frame;
+    numa->node_frames[other_position] = frame_number;
+    numa->frame_positions[other_frame] = position;
+    numa->frame_positions[frame_number] = other_position;
+    numa->frame_nodes[frame_number] = numa->frame_nodes[other_frame];
+    numa->frame_nodes[other_frame] = node;
+}
+
+/// Moves the page in frame_number to node: into a free frame there if there is
+/// one, otherwise in exchange with a page the clock hand finds was not last used from node.
+static void migrate_numa_page(NumaMemory* numa, int frame_number, int node) {
+    int source = numa->frame_nodes[frame_number];
+    int first = numa->node_first[node];
+    int size = numa->node_first[node + 1] - first;
+    if (numa->node_used[node] < size) {
+        /// The free frame joins the used frames of node, and the page's old frame the free ones of source.
+        int position = numa->frame_positions[frame_number];
+        swap_numa_positions(numa, position, first + numa->node_used[node]++);
+        swap_numa_positions(numa, position, numa->node_first[source] + --numa->node_used[source]);
+        numa->migrations++;
+        return;
+    }
+    for (int scanned = 0; scanned < NUMA_MIGRATE_SCAN && scanned < size; scanned++) {
+        int position = first + numa->node_hands[node];
+        numa->node_hands[node] = (numa->node_hands[node] + 1) % size;
+        if (numa->frame_last_nodes[numa->node_frames[position]] != node) {
+            swap_numa_positions(numa, numa->frame_positions[frame_number], position);
+            numa->migrations += 2;
+            return;
+        }
+    }
+    numa->failed_migrations++;
+}
+
+/**
+ * FUNCTION: record_numa_access()
+ * Counts an access by the current CPU as local or remote, takes a
+ * hinting fault on it if it is sampled, and moves on to the next CPU
+ * at the end of the quantum.
+ * */
+void record_numa_access(NumaMemory* numa, int frame_number) {
+    int node = numa->frame_nodes[frame_number];
+    numa->node_accesses[node]++;
+    if (node == numa->home_node) {
+        numa->local_accesses++;
+    } else {
+        numa->remote_accesses++;
+    }
+
+    /// Migrate a page after two hinting faults in a row from the same remote node.
+    if (numa->scan_period > 0 && --numa->scan_left == 0) {
+        numa->scan_left = numa->scan_period;
+        numa->hinting_faults++;
+        int last_node = numa->frame_last_nodes[frame_number];
+        numa->frame_last_nodes[frame_number] = (signed char)numa->home_node;
+        if (node != numa->home_node && last_node == numa->home_node) {
+            migrate_numa_page(numa, frame_number, numa->home_node);
+        }
+    }
+
+    if (--numa->quantum_left == 0) {
+        numa->quantum_left = numa->quantum;
+        numa->cpu = (numa->cpu + 1) % numa->cpu_count;
+        numa->home_node = (int)((int64_t)numa->cpu * numa->node_count / numa->cpu_count);
+    }
+}
+
+/**
+ * FUNCTION: report_numa_memory()
+ * Prints the local and remote accesses, the frames, pages and accesses
+ * of every node, the balancing activity, and the simulated memory time:
+ * every access at its local or remote latency plus every migration at
+ * its cost.
+ * */
+void report_numa_memory(NumaMemory* numa, FILE* stream) {
+    static const char* policy_names[] = { "local", "interleave", "preferred" };
+    uint64_t access_count = numa->local_accesses + numa->remote_accesses;
+    double access_time = (double)numa->local_accesses * numa->local_latency + (double)numa->remote_accesses * numa->remote_latency;
+    double migration_time = (double)numa->migrations * numa->migration_cost;
+    fprintf(stream, "NUMA: %d nodes, %d CPUs, %s allocation, %.0f ns local, %.0f ns remote\n",
+            numa->node_count, numa->cpu_count, policy_names[numa->policy], numa->local_latency, numa->remote_latency);
+    fprintf(stream, "NUMA: %" PRIu64 " local accesses, %" PRIu64 " remote (%.1f%% local, local/remote ratio %.2f)\n",
+            numa->local_accesses, numa->remote_accesses,
+            access_count > 0 ? 100.0 * (double)numa->local_accesses / (double)access_count : 0.0,
+            numa->remote_accesses > 0 ? (double)numa->local_accesses / (double)numa->remote_accesses : 0.0);
+    for (int node = 0; node < numa->node_count; node++) {
+        fprintf(stream, "NUMA: node %d: %d frames, %d pages, %" PRIu64 " accesses\n", node,
+                numa->node_first[node + 1] - numa->node_first[node], numa->node_used[node], numa->node_accesses[node]);
+    }
+    if (numa->scan_period > 0) {
+        fprintf(stream, "NUMA balancing: %" PRIu64 " hinting faults, %" PRIu64 " page migrations, %" PRIu64 " failed\n",
+                numa->hinting_faults, numa->migrations, numa->failed_migrations);
+    }
+    fprintf(stream, "NUMA: simulated time %.3f ms (%.3f ms accesses, %.3f ms migrations)\n",
+            (access_time + migration_time) / 1e6, access_time / 1e6, migration_time / 1e6);
+}
+
+/**
+ * FUNCTION: parse_cache_geometry()
+ * Parses a cache level given as size[:ways[:line size]], such as
+ * "32K:8:64", keeping the current ways and line size when they are left
+ * out. A size of 0 leaves the level out. The number of sets has to be a
+ * power of two. Returns 0 if the text is not a valid cache level.
+ * */
+int parse_cache_geometry(const char* text, CacheGeometry* geometry) {
+    char buffer[CACHE_SPEC_MAX_LENGTH];
+    if (strlen(text) >= sizeof(buffer)) {
+        return 0;
+    }
+    strcpy(buffer, text);
+    CacheGeometry parsed = *geometry;
+    char* ways = strchr(buffer, ':');
+    char* line_size = NULL;
+    if (ways != NULL) {
+        *ways++ = '\0';
+        line_size = strchr(ways, ':');
+        if (line_size != NULL) {
+            *line_size++ = '\0';
+        }
+    }
+    uint64_t number = 0;
+    if (!parse_size(buffer, &parsed.size)) {
+        return 0;
+    }
+    if (ways != NULL) {
+        if (!parse_count(ways, &number) || number == 0 || number > INT32_MAX) {
+            return 0;
+        }
+        parsed.ways = (int)number;
+    }
+    if (line_size != NULL) {
+        if (!parse_size(line_size, &number) || number == 0 || number > CACHE_MAX_LINE_SIZE || (number & (number - 1)) != 0) {
+            return 0;
+        }
+        parsed.line_size = (int)number;
+    }
+    if (parsed.size > 0) {
+        uint64_t set_size = (uint64_t)parsed.ways * (uint64_t)parsed.line_size;
+        uint64_t set_count = parsed.size / set_size;
+        if (parsed.size % set_size != 0 || (set_count & (set_count - 1)) != 0) {
+            return 0;
+        }
+    }
+    *geometry = parsed;
+    return 1;
+}
+
+/**
+ * FUNCTION: create_cache_hierarchy()
+ * Creates the empty cache levels of options->cache_levels, leaving out
+ * those of size zero. Returns NULL if they cannot be allocated.
+ * */
+CacheHierarchy* create_cache_hierarchy(Options* options) {
+    uint64_t memory_size = (uint64_t)options->frame_count * FRAME_SIZE;
+    static const char* level_names[CACHE_LEVELS] = { "L1", "L2", "LLC" };
+    CacheHierarchy* new_caches = (CacheHierarchy*)calloc(1, sizeof(CacheHierarchy));
+    for (int i = 0; i < CACHE_LEVELS; i++) {
+        CacheGeometry* geometry = &options->cache_levels[i];
+        if (geometry->size == 0) {
+            continue;
+        }
+        CacheLevel* level = &new_caches->levels[new_caches->level_count++];
+        uint64_t line_count = geometry->size / (uint64_t)geometry->line_size;
+        level->name = level_names[i];
+        level->geometry = *geometry;
+        level->line_bits = __builtin_ctz((unsigned int)geometry->line_size);
+        level->set_mask = line_count / (uint64_t)geometry->ways - 1;
+        level->tags = (uint64_t*)malloc(sizeof(uint64_t) * line_count);
+        level->stamps = (uint64_t*)calloc(line_count, sizeof(uint64_t));
+        level->shadow_lines = (uint64_t*)malloc(sizeof(uint64_t) * line_count);
+        int* prev = (int*)malloc(sizeof(int) * line_count);
+        int* next = (int*)malloc(sizeof(int) * line_count);
+        level->seen_lines = (uint64_t*)calloc((((memory_size + (uint64_t)geometry->line_size - 1) >> level->line_bits) >> 6) + 1, sizeof(uint64_t));
+        if (level->tags == NULL || level->stamps == NULL || level->shadow_lines == NULL || prev == NULL || next == NULL ||
+            level->seen_lines == NULL) {
+            return NULL;
+        }
+        for (uint64_t line = 0; line < line_count; line++) {
+            level->tags[line] = UINT64_MAX;
+        }
+
+        /// Free shadow entries are chained through the list links.
+        init_frame_list(&level->shadow_lru, prev, next);
+        init_page_index(&level->shadow_index, (int)line_count);
+        for (uint64_t entry = 0; entry < line_count; entry++) {
+            next[entry] = entry + 1 < line_count ? (int)entry + 1 : UNMAPPED;
+        }
+        level->shadow_free = 0;
+    }
+    return new_caches;
+}
+
+/// Looks up a line in the shadow fully-associative cache of a level, making it the most
+/// recently used line there. Returns 1 if the shadow cache held it.
+static int access_shadow_cache(CacheLevel* level, uint64_t line) {
+    FrameList* lru = &level->shadow_lru;
+    int entry = find_page_index(&level->shadow_index, level->shadow_lines, line);
+    if (entry != UNMAPPED) {
+        remove_frame_list(lru, entry);
+        push_frame_list(lru, entry);
+        return 1;
+    }
+    entry = level->shadow_free;
+    if (entry != UNMAPPED) {
+        level->shadow_free = lru->next[entry];
+    } else {
+        entry = lru->tail;
+        remove_page_index(&level->shadow_index, level->shadow_lines, entry);
+        remove_frame_list(lru, entry);
+    }
+    level->shadow_lines[entry] = line;
+    insert_page_index(&level->shadow_index, level->shadow_lines, entry);
+    push_frame_list(lru, entry);
+    return 0;
+}
+
+/// Looks up the line holding address in one level, filling it over the least recently used way on a miss
+/// and classifying the miss.
+static int access_cache_level(CacheLevel* level, uint64_t address) {
+    uint64_t line = address >> level->line_bits;
+    int ways = level->geometry.ways;
+    uint64_t* tags = level->tags + (line & level->set_mask) * (uint64_t)ways;
+    uint64_t* stamps = level->stamps + (line & level->set_mask) * (uint64_t)ways;
+    int victim = 0;
+    int shadow_hit = access_shadow_cache(level, line);
+    level->clock++;
+    for (int way = 0; way < ways; way++) {
+        if (tags[way] == line) {
+            stamps[way] = level->clock;
+            level->hits++;
+            return 1;
+        }
+        if (stamps[way] < stamps[victim]) {
+            victim = way;
+        }
+    }
+    tags[victim] = line;
+    stamps[victim] = level->clock;
+    level->misses++;
+    if (!((level->seen_lines[line >> 6] >> (line & 63)) & 1)) {
+        level->seen_lines[line >> 6] |= (uint64_t)1 << (line & 63);
+        level->compulsory_misses++;
+    } else if (!shadow_hit) {
+        level->capacity_misses++;
+    }
+    return 0;
+}
+
+/**
+ * FUNCTION: access_caches()
+ * Looks up a physical address in each cache level in turn until one
+ * of them holds it, or counts a memory access if none does.
+ * */
+void access_caches(CacheHierarchy* caches, uint64_t address) {
+    for (int i = 0; i < caches->level_count; i++) {
+        if (access_cache_level(&caches->levels[i], address)) {
+            return;
+        }
+    }
+    caches->memory_accesses++;
+}
+
+/**
+ * FUNCTION: invalidate_cached_frame()
+ * Drops the lines of a frame from every cache level, as the copy of a
+ * new page into the frame does. The next miss on them is compulsory.
+ * */
+void invalidate_cached_frame(CacheHierarchy* caches, int frame_number) {
+    uint64_t frame_address = (uint64_t)frame_number << FRAME_NUMBER_OFFSET_BITS;
+    for (int i = 0; i < caches->level_count; i++) {
+        CacheLevel* level = &caches->levels[i];
+        for (uint64_t address = frame_address; address < frame_address + FRAME_SIZE; address += (uint64_t)level->geometry.line_size) {
+            uint64_t line = address >> level->line_bits;
+            uint64_t* tags = level->tags + (line & level->set_mask) * (uint64_t)level->geometry.ways;
+            for (int way = 0; way < level->geometry.ways; way++) {
+                if (tags[way] == line) {
+                    tags[way] = UINT64_MAX;
+                    level->stamps[(line & level->set_mask) * (uint64_t)level->geometry.ways + (uint64_t)way] = 0;
+                }
+            }
+            int entry = find_page_index(&level->shadow_index, level->shadow_lines, line);
+            if (entry != UNMAPPED) {
+                remove_page_index(&level->shadow_index, level->shadow_lines, entry);
+                remove_frame_list(&level->shadow_lru, entry);
+                level->shadow_lru.next[entry] = level->shadow_free;
+                level->shadow_free = entry;
+            }
+            level->seen_lines[line >> 6] &= ~((uint64_t)1 << (line & 63));
+        }
+    }
+}
+
+/**
+ * FUNCTION: report_caches()
+ * Prints the geometry and hit rate of every cache level, with the
+ * number of page colors it has (the distinct sets of cache sets that a
+ * page can map to) and its compulsory, capacity and conflict misses,
+ * and how many accesses went on to memory.
+ * */
+void report_caches(CacheHierarchy* caches, FILE* stream) {
+    uint64_t access_count = 0;
+    for (int i = 0; i < caches->level_count; i++) {
+        CacheLevel* level = &caches->levels[i];
+        uint64_t level_accesses = level->hits + level->misses;
+        uint64_t way_size = (level->set_mask + 1) << level->line_bits;
+        if (i == 0) {
+            access_count = level_accesses;
+        }
+        fprintf(stream, "Cache %s (%" PRIu64 " KB, %d-way, %d B lines, %" PRIu64 " page colors): %" PRIu64 " accesses, %.2f%% hits\n",
+                level->name, level->geometry.size >> 10, level->geometry.ways, level->geometry.line_size,
+                way_size > PAGE_SIZE ? way_size / PAGE_SIZE : 1, level_accesses,
+                level_accesses > 0 ? 100.0 * (double)level->hits / (double)level_accesses : 0.0);
+        fprintf(stream, "Cache %s misses: %" PRIu64 " compulsory, %" PRIu64 " capacity, %" PRIu64 " conflict\n", level->name,
+                level->compulsory_misses, level->capacity_misses, level->misses - level->compulsory_misses - level->capacity_misses);
+    }
+    fprintf(stream, "Cache: %" PRIu64 " accesses went to memory (%.2f%%)\n", caches->memory_accesses,
+            access_count > 0 ? 100.0 * (double)caches->memory_accesses / (double)access_count : 0.0);
+}
+
+/**
+ * FUNCTION: create_page_coloring()
+ * Puts the frame_count frames on the free lists of their colors, lowest
+ * frame number first, and starts every color's recency list empty.
+ * */
+PageColoring* create_page_coloring(int frame_count, int color_count) {
+    PageColoring* new_coloring = (PageColoring*)calloc(1, sizeof(PageColoring));
+    new_coloring->color_count = color_count;
+    new_coloring->color_heads = (int*)malloc(sizeof(int) * color_count);
+    new_coloring->next_free = (int*)malloc(sizeof(int) * frame_count);
+    new_coloring->color_lists = (FrameList*)malloc(sizeof(FrameList) * color_count);
+    int* prev = (int*)malloc(sizeof(int) * frame_count);
+    int* next = (int*)malloc(sizeof(int) * frame_count);
+    for (int color = 0; color < color_count; color++) {
+        new_coloring->color_heads[color] = UNMAPPED;
+        init_frame_list(&new_coloring->color_lists[color], prev, next);
+    }
+    for (int frame_number = frame_count - 1; frame_number >= 0; frame_number--) {
+        new_coloring->next_free[frame_number] = new_coloring->color_heads[frame_number % color_count];
+        new_coloring->color_heads[frame_number % color_count] = frame_number;
+    }
+    return new_coloring;
+}
+
+/**
+ * FUNCTION: allocate_colored_frame()
+ * Takes a free frame of the color of page_number, or of the next color
+ * that still has one. There has to be a free frame of some color.
+ * */
+int allocate_colored_frame(PageColoring* coloring, uint64_t page_number) {
+    int color = (int)(page_number % (uint64_t)coloring->color_count);
+    int wanted_color = color;
+    while (coloring->color_heads[color] == UNMAPPED) {
+        color = (color + 1) % coloring->color_count;
+    }
+    int frame_number = coloring->color_heads[color];
+    coloring->color_heads[color] = coloring->next_free[frame_number];
+    coloring->placements++;
+    coloring->fallbacks += color != wanted_color;
+    return frame_number;
+}
+
+static inline FrameList* color_list(PageColoring* coloring, int frame_number) {
+    return &coloring->color_lists[frame_number % coloring->color_count];
+}
+
+static void colored_access(void* state, int frame_number, uint64_t page_number) {
+    FrameList* list = color_list((PageColoring*)state, frame_number);
+    (void)page_number;
+    if (list->head != frame_number) {
+        remove_frame_list(list, frame_number);
+        push_frame_list(list, frame_number);
+    }
+}
+
+static void colored_install(void* state, int frame_number, uint64_t page_number) {
+    (void)page_number;
+    push_frame_list(color_list((PageColoring*)state, frame_number), frame_number);
+}
+
+/// Takes the least recently used frame of the wanted color. Victims are only taken once
+/// memory is full, and there are no more colors than frames, so every color has one.
+static int colored_victim(void* state) {
+    PageColoring* coloring = (PageColoring*)state;
+    FrameList* list = &coloring->color_lists[coloring->wanted_color];
+    int frame_number = list->tail;
+    remove_frame_list(list, frame_number);
+    return frame_number;
+}
+
+/**
+ * FUNCTION: create_colored_policy()
+ * Creates the replacement policy that page coloring uses once memory is
+ * full: least recently used within the faulting page's color, which
+ * load_page() sets in wanted_color before asking for a victim.
+ * */
+ReplacementPolicy* create_colored_policy(PageColoring* coloring) {
+    ReplacementPolicy* new_policy = (ReplacementPolicy*)calloc(1, sizeof(ReplacementPolicy));
+    new_policy->name = "colored-lru";
+    new_policy->state = coloring;
+    new_policy->access = colored_access;
+    new_policy->install = colored_install;
+    new_policy->victim = colored_victim;
+    return new_policy;
+}
+
+/**
+ * FUNCTION: report_page_coloring()
+ * Prints how many free frames were handed out on the page's own color,
+ * and how many resident pages sit in a frame of their own color.
+ * */
+void report_page_coloring(PhysicalMemory* physical_memory, FILE* stream) {
+    PageColoring* coloring = physical_memory->coloring;
+    uint64_t resident = 0;
+    uint64_t matched = 0;
+    for (int frame_number = 0; frame_number < physical_memory->frame_count; frame_number++) {
+        if (physical_memory->frame_pages[frame_number] != UNMAPPED) {
+            resident++;
+            matched += (uint64_t)physical_memory->frame_pages[frame_number] % (uint64_t)coloring->color_count ==
+                       (uint64_t)frame_number % (uint64_t)coloring->color_count;
+        }
+    }
+    fprintf(stream, "Page coloring (%d colors): %" PRIu64 " free frames allocated, %.1f%% on the page's own color\n",
+            coloring->color_count, coloring->placements,
+            coloring->placements > 0 ? 100.0 * (double)(coloring->placements - coloring->fallbacks) / (double)coloring->placements : 0.0);
+    fprintf(stream, "Page coloring: %" PRIu64 " of %" PRIu64 " resident pages in a frame of their own color (%.1f%%)\n", matched, resident,
+            resident > 0 ? 100.0 * (double)matched / (double)resident : 0.0);
+}
+
+/**
+ * FUNCTION: page_table_levels()
+ * Returns how many levels a radix page table over page_count pages has,
+ * with PAGE_TABLE_LEVEL_BITS bits of the page number per level.
+ * */
+int page_table_levels(uint64_t page_count) {
+    int bits = 1;
+    while (bits < 64 && ((uint64_t)1 << bits) < page_count) {
+        bits++;
+    }
+    return (bits + PAGE_TABLE_LEVEL_BITS - 1) / PAGE_TABLE_LEVEL_BITS;
+}
+
+/**
+ * FUNCTION: create_virtual_machine()
+ * Creates a guest with a page table over page_count guest virtual pages,
+ * options->guest_page_count empty guest-physical pages, and an empty
+ * nested TLB if one was asked for. Returns NULL if the guest replacement
+ * policy is unknown.
+ * */
+VirtualMachine* create_virtual_machine(Options* options, uint64_t page_count) {
+    VirtualMachine* new_virtual_machine = (VirtualMachine*)calloc(1, sizeof(VirtualMachine));
+    new_virtual_machine->mode = options->virtualization;
+    new_virtual_machine->guest_table = create_page_table(page_count);
+    new_virtual_machine->guest_policy = create_replacement_policy(options->guest_policy_name, options->guest_page_count);
+    if (new_virtual_machine->guest_table == NULL || new_virtual_machine->guest_policy == NULL) {
+        return NULL;
+    }
+    new_virtual_machine->guest_page_count = options->guest_page_count;
+    new_virtual_machine->guest_levels = page_table_levels(page_count);
+    new_virtual_machine->host_levels = page_table_levels((uint64_t)options->guest_page_count);
+    new_virtual_machine->tlb_entries = options->nested_tlb_entries;
+    new_virtual_machine->tlb_missed = 1;
+    if (options->virtualization == VIRTUALIZATION_SHADOW) {
+        new_virtual_machine->shadow_map = (int*)malloc(sizeof(int) * page_count);
+        if (new_virtual_machine->shadow_map == NULL) {
+            return NULL;
+        }
+        for (uint64_t page_number = 0; page_number < page_count; page_number++) {
+            new_virtual_machine->shadow_map[page_number] = UNMAPPED;
+        }
+    }
+    if (options->nested_tlb_entries > 0) {
+        int entry_count = options->nested_tlb_entries;
+        new_virtual_machine->tlb_pages = (uint64_t*)malloc(sizeof(uint64_t) * entry_count);
+        new_virtual_machine->tlb_guest_pages = (uint64_t*)malloc(sizeof(uint64_t) * entry_count);
+        new_virtual_machine->tlb_frames = (int*)malloc(sizeof(int) * entry_count);
+        int* next = (int*)malloc(sizeof(int) * entry_count);
+        init_frame_list(&new_virtual_machine->tlb_lru, (int*)malloc(sizeof(int) * entry_count), next);
+        init_page_index(&new_virtual_machine->tlb_index, entry_count);
+
+        /// Free entries are chained through the list links.
+        for (int entry = 0; entry < entry_count; entry++) {
+            next[entry] = entry + 1 < entry_count ? entry + 1 : UNMAPPED;
+        }
+        new_virtual_machine->tlb_free = 0;
+    }
+    return new_virtual_machine;
+}
+
+/// Drops an entry from the nested TLB.
+static void remove_nested_tlb_entry(VirtualMachine* virtual_machine, int entry) {
+    remove_page_index(&virtual_machine->tlb_index, virtual_machine->tlb_pages, entry);
+    remove_frame_list(&virtual_machine->tlb_lru, entry);
+    virtual_machine->tlb_lru.next[entry] = virtual_machine->tlb_free;
+    virtual_machine->tlb_free = entry;
+}
+
+/**
+ * FUNCTION: translate_guest_page()
+ * Translates a guest virtual page to the guest-physical page it is in,
+ * from the TLB if it holds a current translation, otherwise by a
+ * two-dimensional walk (nested paging) or a walk of the shadow table
+ * (shadow paging), taking a guest fault if the guest has not mapped the
+ * page. The host side of the translation is left to the caller, which
+ * completes the shadow entry and the TLB once it has the host frame.
+ * */
+uint64_t translate_guest_page(PhysicalMemory* physical_memory, PageTable* page_table, BackingStore* backing_store, uint64_t page_number) {
+    VirtualMachine* virtual_machine = page_table->guest;
+    PageTable* guest_table = virtual_machine->guest_table;
+    virtual_machine->translations++;
+    virtual_machine->tlb_missed = 1;
+
+    /// A TLB entry is only used while both the guest and the host still map the page
+    /// the same way; a stale one is dropped as a shootdown would have done.
+    if (virtual_machine->tlb_entries > 0) {
+        int entry = find_page_index(&virtual_machine->tlb_index, virtual_machine->tlb_pages, page_number);
+        if (entry != UNMAPPED) {
+            uint64_t guest_page_number = virtual_machine->tlb_guest_pages[entry];
+            if (guest_table->map[page_number] == (int)guest_page_number &&
+                page_table->map[guest_page_number] == virtual_machine->tlb_frames[entry]) {
+                remove_frame_list(&virtual_machine->tlb_lru, entry);
+                push_frame_list(&virtual_machine->tlb_lru, entry);
+                virtual_machine->tlb_hits++;
+                virtual_machine->tlb_missed = 0;
+                return guest_page_number;
+            }
+            remove_nested_tlb_entry(virtual_machine, entry);
+        }
+    }
+
+    /// Each guest level the walk caches skip saves a whole host walk under nested paging.
+    virtual_machine->walks++;
+    int guest_references = virtual_machine->guest_levels;
+    if (page_table->walk_cache != NULL) {
+        guest_references = walk_page_table(page_table->walk_cache, page_number);
+    }
+    if (virtual_machine->mode == VIRTUALIZATION_SHADOW) {
+        virtual_machine->walk_references += (uint64_t)guest_references;
+        if (virtual_machine->shadow_map[page_number] == UNMAPPED) {
+            virtual_machine->shadow_faults++;
+            virtual_machine->walk_references += (uint64_t)(virtual_machine->guest_levels + virtual_machine->host_levels);
+        }
+    } else {
+        virtual_machine->walk_references += (uint64_t)(guest_references * (virtual_machine->host_levels + 1) + virtual_machine->host_levels);
+    }
+    int guest_page_number = guest_table->map[page_number];
+    if (guest_page_number == UNMAPPED) {
+        guest_page_number = service_guest_fault(physical_memory, page_table, backing_store, page_number);
+    } else if (virtual_machine->guest_policy->access != NULL) {
+        virtual_machine->guest_policy->access(virtual_machine->guest_policy->state, guest_page_number, page_number);
+    }
+    return (uint64_t)guest_page_number;
+}
+
+/**
+ * FUNCTION: service_guest_fault()
+ * Handles a guest fault on a guest virtual page: takes a free
+ * guest-physical page, or evicts the one the guest policy picks, and
+ * has the guest read the page into it. If the host has the
+ * guest-physical page in a frame the data lands there; otherwise the
+ * host fault that follows reads it. Under shadow paging each of the
+ * guest's page table writes traps and is synchronized into the shadow
+ * table. Returns the guest-physical page.
+ * */
+int service_guest_fault(PhysicalMemory* physical_memory, PageTable* page_table, BackingStore* backing_store, uint64_t page_number) {
+    VirtualMachine* virtual_machine = page_table->guest;
+    PageTable* guest_table = virtual_machine->guest_table;
+    guest_table->fault_count++;
+
+    int guest_page_number;
+    if (virtual_machine->next_guest_page < virtual_machine->guest_page_count) {
+        guest_page_number = virtual_machine->next_guest_page++;
+    } else {
+        guest_page_number = virtual_machine->guest_policy->victim(virtual_machine->guest_policy->state);
+        uint64_t evicted_page = page_table->backing_pages[guest_page_number];
+        guest_table->map[evicted_page] = UNMAPPED;
+        virtual_machine->guest_evictions++;
+        virtual_machine->guest_table_updates++;
+        if (virtual_machine->mode == VIRTUALIZATION_SHADOW) {
+            virtual_machine->shadow_map[evicted_page] = UNMAPPED;
+            virtual_machine->shadow_syncs++;
+        }
+    }
+    int frame_number = page_table->map[guest_page_number];
+    guest_table->map[page_number] = guest_page_number;
+    page_table->backing_pages[guest_page_number] = page_number;
+    virtual_machine->guest_policy->install(virtual_machine->guest_policy->state, guest_page_number, page_number);
+    virtual_machine->guest_table_updates++;
+    if (virtual_machine->mode == VIRTUALIZATION_SHADOW) {
+        virtual_machine->shadow_map[page_number] = frame_number;
+        virtual_machine->shadow_syncs++;
+    }
+
+    if (frame_number != UNMAPPED) {
+        read_backing_store_page(backing_store, page_number, physical_memory->space + (size_t)frame_number * FRAME_SIZE);
+        if (__builtin_expect(physical_memory->caches != NULL, 0)) {
+            invalidate_cached_frame(physical_memory->caches, frame_number);
+        }
+    }
+    return guest_page_number;
+}
+
+/**
+ * FUNCTION: invalidate_shadow_page()
+ * Drops the shadow entry that points to the frame of a guest-physical
+ * page the host is taking away.
+ * */
+void invalidate_shadow_page(PageTable* page_table, uint64_t guest_page_number) {
+    VirtualMachine* virtual_machine = page_table->guest;
+    uint64_t page_number = page_table->backing_pages[guest_page_number];
+    if (virtual_machine->shadow_map[page_number] != UNMAPPED && virtual_machine->guest_table->map[page_number] == (int)guest_page_number) {
+        virtual_machine->shadow_map[page_number] = UNMAPPED;
+        virtual_machine->shadow_invalidations++;
+    }
+}
+
+/**
+ * FUNCTION: complete_guest_translation()
+ * Records the host frame of a translated guest virtual page in its
+ * shadow entry under shadow paging, and caches the combined translation
+ * in the TLB, replacing the least recently used entry if it is full.
+ * */
+void complete_guest_translation(VirtualMachine* virtual_machine, uint64_t page_number, uint64_t guest_page_number, int frame_number) {
+    if (virtual_machine->mode == VIRTUALIZATION_SHADOW) {
+        virtual_machine->shadow_map[page_number] = frame_number;
+    }
+    if (virtual_machine->tlb_entries == 0) {
+        return;
+    }
+    int entry = virtual_machine->tlb_free;
+    if (entry != UNMAPPED) {
+        virtual_machine->tlb_free = virtual_machine->tlb_lru.next[entry];
+    } else {
+        entry = virtual_machine->tlb_lru.tail;
+        remove_page_index(&virtual_machine->tlb_index, virtual_machine->tlb_pages, entry);
+        remove_frame_list(&virtual_machine->tlb_lru, entry);
+    }
+    virtual_machine->tlb_pages[entry] = page_number;
+    virtual_machine->tlb_guest_pages[entry] = guest_page_number;
+    virtual_machine->tlb_frames[entry] = frame_number;
+    insert_page_index(&virtual_machine->tlb_index, virtual_machine->tlb_pages, entry);
+    push_frame_list(&virtual_machine->tlb_lru, entry);
+}
+
+/**
+ * FUNCTION: report_virtual_machine()
+ * Prints the guest and host faults, the TLB hit rate, the memory
+ * references of the walks against what native walks of the guest page
+ * table alone would have cost, and the guest page table updates, which
+ * shadow paging traps and synchronizes.
+ * */
+void report_virtual_machine(PageTable* page_table, FILE* stream) {
+    VirtualMachine* virtual_machine = page_table->guest;
+    int shadow = virtual_machine->mode == VIRTUALIZATION_SHADOW;
+    int walk_length = shadow ? virtual_machine->guest_levels : (virtual_machine->guest_levels + 1) * (virtual_machine->host_levels + 1) - 1;
+    fprintf(stream, "Virtualization (%s paging): %d guest-physical pages, %d-level guest and %d-level host page tables\n",
+            shadow ? "shadow" : "nested", virtual_machine->guest_page_count, virtual_machine->guest_levels, virtual_machine->host_levels);
+    fprintf(stream, "Virtualization: %" PRIu64 " guest faults (%" PRIu64 " guest evictions), %" PRIu64 " host faults\n",
+            virtual_machine->guest_table->fault_count, virtual_machine->guest_evictions, page_table->fault_count);
+    if (virtual_machine->tlb_entries > 0) {
+        fprintf(stream, "%s TLB (%d entries): %.2f%% hits\n", shadow ? "Shadow" : "Nested", virtual_machine->tlb_entries,
+                virtual_machine->translations > 0 ? 100.0 * (double)virtual_machine->tlb_hits / (double)virtual_machine->translations : 0.0);
+    }
+    fprintf(stream, "Virtualization: %" PRIu64 " %s walks of %d references, %" PRIu64 " references (%.2f per access, %.1fx a native %d-level walk)\n",
+            virtual_machine->walks, shadow ? "shadow" : "2D", walk_length, virtual_machine->walk_references,
+            virtual_machine->translations > 0 ? (double)virtual_machine->walk_references / (double)virtual_machine->translations : 0.0,
+            virtual_machine->walks > 0 ? (double)virtual_machine->walk_references / (double)virtual_machine->walks / (double)virtual_machine->guest_levels : 0.0,
+            virtual_machine->guest_levels);
+    if (shadow) {
+        fprintf(stream, "Shadow paging: %" PRIu64 " guest page table updates trapped and synced, %" PRIu64 " shadow faults "
+                "(exits walking %d references), %" PRIu64 " shadow entries dropped for host evictions\n",
+                virtual_machine->shadow_syncs, virtual_machine->shadow_faults,
+                virtual_machine->guest_levels + virtual_machine->host_levels, virtual_machine->shadow_invalidations);
+    } else {
+        fprintf(stream, "Nested paging: %" PRIu64 " guest page table updates, none trapped\n", virtual_machine->guest_table_updates);
+    }
+}
+
+/**
+ * FUNCTION: create_page_walk_cache()
+ * Creates empty caches of entries entries for each upper level of a
+ * page table of levels levels.
+ * */
+PageWalkCache* create_page_walk_cache(int levels, int entries) {
+    PageWalkCache* new_walk_cache = (PageWalkCache*)calloc(1, sizeof(PageWalkCache));
+    new_walk_cache->levels = levels < PAGE_WALK_MAX_LEVELS ? levels : PAGE_WALK_MAX_LEVELS;
+    new_walk_cache->entries = entries;
+    new_walk_cache->tags = (uint64_t*)malloc(sizeof(uint64_t) * (size_t)entries * PAGE_WALK_MAX_LEVELS);
+    new_walk_cache->stamps = (uint64_t*)calloc((size_t)entries * PAGE_WALK_MAX_LEVELS, sizeof(uint64_t));
+    for (int entry = 0; entry < entries * PAGE_WALK_MAX_LEVELS; entry++) {
+        new_walk_cache->tags[entry] = UINT64_MAX;
+    }
+    return new_walk_cache;
+}
+
+/**
+ * FUNCTION: walk_page_table()
+ * Walks the page table for page_number through the page walk caches.
+ * Returns the number of levels whose entries had to be read from memory.
+ * */
+int walk_page_table(PageWalkCache* walk_cache, uint64_t page_number) {
+    int skipped = 0;
+    walk_cache->walks++;
+    for (int level = 0; level < walk_cache->levels - 1; level++) {
+        uint64_t prefix = page_number >> (PAGE_TABLE_LEVEL_BITS * (walk_cache->levels - 1 - level));
+        uint64_t* tags = walk_cache->tags + (size_t)level * walk_cache->entries;
+        uint64_t* stamps = walk_cache->stamps + (size_t)level * walk_cache->entries;
+        int victim = 0;
+        int hit = 0;
+        walk_cache->clock++;
+        for (int entry = 0; entry < walk_cache->entries; entry++) {
+            if (tags[entry] == prefix) {
+                stamps[entry] = walk_cache->clock;
+                hit = 1;
+                break;
+            }
+            if (stamps[entry] < stamps[victim]) {
+                victim = entry;
+            }
+        }
+        if (hit) {
+            walk_cache->level_hits[level]++;
+            skipped = level + 1;
+        } else {
+            tags[victim] = prefix;
+            stamps[victim] = walk_cache->clock;
+        }
+    }
+    walk_cache->skipped_levels += (uint64_t)skipped;
+    return walk_cache->levels - skipped;
+}
+
+/**
+ * FUNCTION: report_page_walk_cache()
+ * Prints the hit rate of each upper level's cache and the memory
+ * references the caches saved, level_references per skipped level.
+ * */
+void report_page_walk_cache(PageWalkCache* walk_cache, int level_references, FILE* stream) {
+    static const char* level_names[PAGE_WALK_MAX_LEVELS - 1] = { "PD", "PDPT", "PML4", "PML5" };
+    uint64_t uncached = walk_cache->walks * (uint64_t)walk_cache->levels * (uint64_t)level_references;
+    uint64_t skipped = walk_cache->skipped_levels * (uint64_t)level_references;
+    fprintf(stream, "Page walk caches (%d entries per level, %d-level table): %" PRIu64 " walks, %" PRIu64 " references skipped (%.1f%% of the table's references)\n",
+            walk_cache->entries, walk_cache->levels, walk_cache->walks, skipped,
+            uncached > 0 ? 100.0 * (double)skipped / (double)uncached : 0.0);
+    for (int level = 0; level < walk_cache->levels - 1; level++) {
+        fprintf(stream, "Page walk caches: %s entries %.2f%% hits\n", level_names[walk_cache->levels - 2 - level],
+                walk_cache->walks > 0 ? 100.0 * (double)walk_cache->level_hits[level] / (double)walk_cache->walks : 0.0);
+    }
+}
+
+/**
+ * FUNCTION: parse_region()
+ * Parses a region given as kind:start:end[:permissions], such as
+ * "code:0:16K:rx" or "guard:60K:64K", where the permissions are any of
+ * the letters r, w and x (or - for none). Guard pages cannot be accessed
+ * at all, so a guard region takes no permissions. Returns 0 if the text
+ * is not a valid region.
+ * */
+int parse_region(const char* text, Region* region) {
+    static const char* kind_names[] = { "code", "heap", "stack", "guard" };
+    static const int kind_protections[] = { PAGE_READ | PAGE_EXECUTE, PAGE_READ | PAGE_WRITE, PAGE_READ | PAGE_WRITE, PAGE_GUARD };
+    char buffer[REGION_SPEC_MAX_LENGTH];
+    if (strlen(text) >= sizeof(buffer)) {
+        return 0;
+    }
+    strcpy(buffer, text);
+    char* fields[4] = { buffer, NULL, NULL, NULL };
+    int field_count = 1;
+    for (char* c = buffer; *c != '\0' && field_count < 4; c++) {
+        if (*c == ':') {
+            *c = '\0';
+            fields[field_count++] = c + 1;
+        }
+    }
+    if (field_count < 3 || !parse_size(fields[1], &region->start) || !parse_size(fields[2], &region->end) || region->end <= region->start) {
+        return 0;
+    }
+    int kind = 0;
+    while (kind < 4 && strcmp(fields[0], kind_names[kind]) != 0) {
+        kind++;
+    }
+    if (kind == 4) {
+        return 0;
+    }
+    region->kind = (RegionKind)kind;
+    region->protection = kind_protections[kind];
+    if (fields[3] != NULL && region->kind == REGION_GUARD) {
+        return 0;
+    }
+    if (fields[3] != NULL) {
+        region->protection = 0;
+        for (const char* c = fields[3]; *c != '\0'; c++) {
+            if (*c == 'r') {
+                region->protection |= PAGE_READ;
+            } else if (*c == 'w') {
+                region->protection |= PAGE_WRITE;
+            } else if (*c == 'x') {
+                region->protection |= PAGE_EXECUTE;
+            } else if (*c != '-') {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * FUNCTION: create_protections()
+ * Creates the protection bits of page_count virtual pages from the
+ * region map: every page a region touches gets the region's protection
+ * (later regions win), and pages outside every region are invalid.
+ * Returns NULL if the table cannot be allocated.
+ * */
+unsigned char* create_protections(uint64_t page_count, Region* regions, int region_count) {
+    unsigned char* protections = (unsigned char*)calloc(page_count, sizeof(unsigned char));
+    if (protections == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < region_count; i++) {
+        uint64_t first_page = regions[i].start >> PAGE_NUMBER_OFFSET_BITS;
+        uint64_t end_page = (regions[i].end + PAGE_SIZE - 1) >> PAGE_NUMBER_OFFSET_BITS;
+        for (uint64_t page_number = first_page; page_number < end_page && page_number < page_count; page_number++) {
+            protections[page_number] = (unsigned char)(PAGE_VALID | regions[i].protection);
+        }
+    }
+    return protections;
+}
+
+/**
+ * FUNCTION: record_protection_fault()
+ * Counts an access refused by the protection check by its cause, and
+ * notes the cause in the address to be written in place of a translation.
+ * */
+void record_protection_fault(PageTable* page_table, VirtualAddress* virtual_address) {
+    uint64_t page_count = page_table->guest != NULL ? page_table->guest->guest_table->page_count : page_table->page_count;
+    int protection = 0;
+    if (virtual_address->page_number < page_count && page_table->protections != NULL) {
+        protection = page_table->protections[virtual_address->page_number];
+    }
+    ProtectionFault fault = PROTECTION_READ;
+    if (!(protection & PAGE_VALID)) {
+        fault = PROTECTION_UNMAPPED;
+    } else if (protection & PAGE_GUARD) {
+        fault = PROTECTION_GUARD;
+    } else if (virtual_address->access & PAGE_WRITE) {
+        fault = PROTECTION_WRITE;
+    } else if (virtual_address->access & PAGE_EXECUTE) {
+        fault = PROTECTION_EXECUTE;
+    }
+    page_table->protection_faults[fault]++;
+    virtual_address->protection_fault = fault;
+}
+
+/**
+ * FUNCTION: report_protection_faults()
+ * Prints the accesses refused by the protection check, by cause.
+ * */
+void report_protection_faults(PageTable* page_table, FILE* stream) {
+    uint64_t* faults = page_table->protection_faults;
+    fprintf(stream, "Protection faults: %" PRIu64 " (%" PRIu64 " unmapped, %" PRIu64 " guard page, %" PRIu64 " read, %" PRIu64 " write, %" PRIu64 " execute)\n",
+            faults[PROTECTION_UNMAPPED] + faults[PROTECTION_GUARD] + faults[PROTECTION_READ] + faults[PROTECTION_WRITE] + faults[PROTECTION_EXECUTE],
+            faults[PROTECTION_UNMAPPED], faults[PROTECTION_GUARD], faults[PROTECTION_READ], faults[PROTECTION_WRITE], faults[PROTECTION_EXECUTE]);
+}